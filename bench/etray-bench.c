@@ -0,0 +1,680 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* The D-Bus side of the benchmarks (see run.sh), talking to the plugin on
+ * the private session bus of a benchmark run:
+ *
+ *   now      print the current CLOCK_MONOTONIC time, in microseconds, which
+ *            is also the clock of the plugin's flight recorder
+ *   watcher  stand in for the StatusNotifierWatcher and the tray (the host),
+ *            logging every registration and every item signal, with the
+ *            time it arrived, one tab-separated line each
+ *   menu     click the tray menu entry whose label starts with the given
+ *            text, like a tray would
+ *   report   fetch the plugin's flight recorder (DumpTrace), and print the
+ *            init stage timings, and the latency from each unread count
+ *            event that made the icon change to the NewIcon signal reaching
+ *            the watcher (given its log), as JSON
+ *   schedule check from the flight recorder that the adaptive refresh
+ *            polled the accounts when the scheduler said, within the
+ *            given interval bounds, and print those refreshes as JSON
+ *
+ * All times share the same clock, so the latencies are simple differences
+ * of records from the two sides. */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+
+#include "sn.h"
+#include "api.h"
+
+#define WATCHER_NAME "org.kde.StatusNotifierWatcher"
+#define WATCHER_PATH "/StatusNotifierWatcher"
+#define DBUSMENU_INTERFACE "com.canonical.dbusmenu"
+
+#define CALL_TIMEOUT_MS 10000
+
+// How far off a refresh may be from when it was due
+#define SCHEDULE_SLACK_US (3 * G_USEC_PER_SEC / 2)
+
+static const gchar watcher_xml[] =
+"<node>"
+"  <interface name='" WATCHER_NAME "'>"
+"	<method name='RegisterStatusNotifierItem'>"
+"	  <arg type='s' name='service' direction='in'/>"
+"	</method>"
+"	<method name='RegisterStatusNotifierHost'>"
+"	  <arg type='s' name='service' direction='in'/>"
+"	</method>"
+"	<property name='RegisteredStatusNotifierItems' type='as' access='read'/>"
+"	<property name='IsStatusNotifierHostRegistered' type='b' access='read'/>"
+"	<property name='ProtocolVersion' type='i' access='read'/>"
+"	<signal name='StatusNotifierItemRegistered'>"
+"	  <arg type='s' name='service'/>"
+"	</signal>"
+"  </interface>"
+"</node>";
+
+static GMainLoop *loop = NULL;
+
+// "<bus name><object path>" of every registered item
+static GPtrArray *registered = NULL;
+
+static void usage(const char *prog) {
+	fprintf(stderr, "Usage: %s now\n"
+		"       %s watcher\n"
+		"       %s menu LABEL\n"
+		"       %s report [-w WATCHER_LOG] [-s SINCE_US]\n"
+		"       %s schedule [-s SINCE_US] [-m MIN_S] [-M MAX_S] [-n COUNT]\n",
+		prog, prog, prog, prog, prog);
+}
+
+static GDBusConnection *get_bus(void) {
+	GError *error = NULL;
+	GDBusConnection *bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+	
+	if(!bus) {
+		fprintf(stderr, "etray-bench: can't connect to the session bus: %s\n",
+			error->message);
+		g_error_free(error);
+	}
+	
+	return bus;
+}
+
+static void log_event(const gchar *event, const gchar *sender,
+	const gchar *path, const gchar *detail)
+{
+	printf("%" G_GINT64_FORMAT "\t%s\t%s\t%s\t%s\n", g_get_monotonic_time(),
+		event, sender ? sender : "", path ? path : "", detail ? detail : "");
+	fflush(stdout);
+}
+
+// -----------------------------
+
+static void on_icon_name(GObject *source, GAsyncResult *result, gpointer user_data) {
+	gchar *item = user_data;
+	GVariant *value = NULL;
+	
+	GVariant *ret = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, NULL);
+	
+	if(ret) {
+		g_variant_get(ret, "(v)", &value);
+		log_event("IconName", NULL, item, g_variant_get_string(value, NULL));
+		
+		g_variant_unref(value);
+		g_variant_unref(ret);
+	}
+	
+	g_free(item);
+}
+
+/* Any signal of any item. On NewIcon, also read the new icon, like a tray
+ * would, so that the time the host actually has it is logged too. */
+static void on_item_signal(GDBusConnection *bus, const gchar *sender,
+	const gchar *path, const gchar *iface, const gchar *signal,
+	GVariant *params, gpointer user_data)
+{
+	const gchar *detail = NULL;
+	
+	if(g_variant_is_of_type(params, G_VARIANT_TYPE("(s)")))
+		g_variant_get(params, "(&s)", &detail);
+	
+	log_event(signal, sender, path, detail);
+	
+	if(g_strcmp0(signal, "NewIcon") == 0) {
+		g_dbus_connection_call(bus, sender, path,
+			"org.freedesktop.DBus.Properties", "Get",
+			g_variant_new("(ss)", SNI_INTERFACE, "IconName"),
+			G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE, CALL_TIMEOUT_MS,
+			NULL, on_icon_name, g_strdup(path));
+	}
+}
+
+static void on_watcher_method_call(GDBusConnection *bus, const gchar *sender,
+	const gchar *object_path, const gchar *iface, const gchar *method_name,
+	GVariant *params, GDBusMethodInvocation *inv, gpointer user_data)
+{
+	const gchar *service;
+	g_variant_get(params, "(&s)", &service);
+	
+	if(g_strcmp0(method_name, "RegisterStatusNotifierItem") == 0) {
+		/* By object path (on the caller's connection), by bus name, or by
+		 * bus name followed by object path */
+		const gchar *slash = strchr(service, '/');
+		
+		gchar *name = (slash == service ? g_strdup(sender)
+			: slash ? g_strndup(service, slash - service) : g_strdup(service));
+		const gchar *path = (slash ? slash : SNI_OBJECT_PATH);
+		
+		log_event("register", name, path, NULL);
+		g_ptr_array_add(registered, g_strconcat(name, path, NULL));
+		g_free(name);
+		
+		g_dbus_connection_emit_signal(bus, NULL, WATCHER_PATH, WATCHER_NAME,
+			"StatusNotifierItemRegistered", g_variant_new("(s)", service), NULL);
+	}
+	
+	g_dbus_method_invocation_return_value(inv, NULL);
+}
+
+static GVariant *on_watcher_get_property(GDBusConnection *bus, const gchar *sender,
+	const gchar *object_path, const gchar *iface, const gchar *property_name,
+	GError **error, gpointer user_data)
+{
+	if(g_strcmp0(property_name, "RegisteredStatusNotifierItems") == 0) {
+		return g_variant_new_strv((const gchar * const *) registered->pdata,
+			registered->len);
+	}
+	
+	if(g_strcmp0(property_name, "IsStatusNotifierHostRegistered") == 0)
+		return g_variant_new_boolean(TRUE);
+	if(g_strcmp0(property_name, "ProtocolVersion") == 0)
+		return g_variant_new_int32(0);
+	
+	return NULL;
+}
+
+static void on_watcher_name_lost(GDBusConnection *bus,
+	const gchar *name, gpointer user_data)
+{
+	fprintf(stderr, "etray-bench: couldn't own %s (is a tray running "
+		"on this bus?)\n", name);
+	
+	g_main_loop_quit(loop);
+}
+
+static gboolean on_quit_signal(gpointer user_data) {
+	g_main_loop_quit(loop);
+	return G_SOURCE_REMOVE;
+}
+
+static int cmd_watcher(void) {
+	GError *error = NULL;
+	
+	GDBusConnection *bus = get_bus();
+	if(!bus) return 1;
+	
+	GDBusNodeInfo *node = g_dbus_node_info_new_for_xml(watcher_xml, &error);
+	g_assert_no_error(error);
+	
+	static const GDBusInterfaceVTable vtable = {
+		.method_call = on_watcher_method_call,
+		.get_property = on_watcher_get_property
+	};
+	
+	registered = g_ptr_array_new_with_free_func(g_free);
+	loop = g_main_loop_new(NULL, FALSE);
+	
+	guint registration_id = g_dbus_connection_register_object(bus, WATCHER_PATH,
+		node->interfaces[0], &vtable, NULL, NULL, &error);
+	
+	if(!registration_id) {
+		fprintf(stderr, "etray-bench: can't export the watcher: %s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	
+	guint subscription_id = g_dbus_connection_signal_subscribe(bus, NULL,
+		SNI_INTERFACE, NULL, NULL, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+		on_item_signal, NULL, NULL);
+	
+	guint owner_id = g_bus_own_name_on_connection(bus, WATCHER_NAME,
+		G_BUS_NAME_OWNER_FLAGS_DO_NOT_QUEUE, NULL, on_watcher_name_lost, NULL, NULL);
+	
+	g_unix_signal_add(SIGINT, on_quit_signal, NULL);
+	g_unix_signal_add(SIGTERM, on_quit_signal, NULL);
+	
+	log_event("watcher", g_dbus_connection_get_unique_name(bus), WATCHER_PATH, NULL);
+	
+	g_main_loop_run(loop);
+	
+	g_bus_unown_name(owner_id);
+	g_dbus_connection_signal_unsubscribe(bus, subscription_id);
+	g_dbus_connection_unregister_object(bus, registration_id);
+	
+	g_main_loop_unref(loop);
+	g_ptr_array_unref(registered);
+	g_dbus_node_info_unref(node);
+	g_object_unref(bus);
+	
+	return 0;
+}
+
+// -----------------------------
+
+// The id of the first menu entry whose label (sans mnemonics) starts with prefix
+static gint find_menu_entry(GVariant *layout, const gchar *prefix) {
+	GVariant *props, *children;
+	const gchar *label;
+	gint id;
+	
+	g_variant_get(layout, "(i@a{sv}@av)", &id, &props, &children);
+	
+	if(g_variant_lookup(props, "label", "&s", &label)) {
+		gchar **parts = g_strsplit(label, "_", -1);
+		gchar *plain = g_strjoinv("", parts);
+		
+		if(!g_str_has_prefix(plain, prefix))
+			id = -1;
+		
+		g_strfreev(parts);
+		g_free(plain);
+	} else
+		id = -1;
+	
+	for(gsize i = 0; id < 0 && i < g_variant_n_children(children); i++) {
+		GVariant *child = g_variant_get_child_value(children, i);
+		GVariant *child_layout = g_variant_get_variant(child);
+		
+		id = find_menu_entry(child_layout, prefix);
+		
+		g_variant_unref(child_layout);
+		g_variant_unref(child);
+	}
+	
+	g_variant_unref(props);
+	g_variant_unref(children);
+	
+	return id;
+}
+
+static int cmd_menu(const gchar *prefix) {
+	GError *error = NULL;
+	GVariant *layout;
+	guint revision;
+	
+	const gchar *no_properties[] = {NULL};
+	
+	GDBusConnection *bus = get_bus();
+	if(!bus) return 1;
+	
+	GVariant *ret = g_dbus_connection_call_sync(bus, DBUS_SERVICE_NAME,
+		SNI_MENU_PATH, DBUSMENU_INTERFACE, "GetLayout",
+		g_variant_new("(ii@as)", 0, -1, g_variant_new_strv(no_properties, -1)),
+		G_VARIANT_TYPE("(u(ia{sv}av))"), G_DBUS_CALL_FLAGS_NONE,
+		CALL_TIMEOUT_MS, NULL, &error);
+	
+	if(!ret) {
+		fprintf(stderr, "etray-bench: can't get the menu: %s\n", error->message);
+		g_error_free(error);
+		g_object_unref(bus);
+		return 1;
+	}
+	
+	g_variant_get(ret, "(u@(ia{sv}av))", &revision, &layout);
+	gint id = find_menu_entry(layout, prefix);
+	
+	g_variant_unref(layout);
+	g_variant_unref(ret);
+	
+	if(id < 0) {
+		fprintf(stderr, "etray-bench: no menu entry '%s'\n", prefix);
+		g_object_unref(bus);
+		return 1;
+	}
+	
+	ret = g_dbus_connection_call_sync(bus, DBUS_SERVICE_NAME,
+		SNI_MENU_PATH, DBUSMENU_INTERFACE, "Event",
+		g_variant_new("(isvu)", id, "clicked", g_variant_new_int32(0),
+			(guint32) time(NULL)),
+		NULL, G_DBUS_CALL_FLAGS_NONE, CALL_TIMEOUT_MS, NULL, &error);
+	
+	if(!ret) {
+		fprintf(stderr, "etray-bench: can't click '%s': %s\n", prefix, error->message);
+		g_error_free(error);
+		g_object_unref(bus);
+		return 1;
+	}
+	
+	g_variant_unref(ret);
+	g_object_unref(bus);
+	
+	return 0;
+}
+
+// -----------------------------
+
+typedef struct record_t {
+	gint64 time;
+	const gchar *type;
+	const gchar *what;
+	gint a, b, c;
+} record_t;
+
+static gint compare_gint64(gconstpointer a, gconstpointer b) {
+	gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+	return (x > y) - (x < y);
+}
+
+/* The times at which NewIcon signals from the main item
+ * reached the watcher, from its log, in order. */
+static GArray *read_new_icons(const gchar *path) {
+	GArray *times = g_array_new(FALSE, FALSE, sizeof(gint64));
+	gchar *contents = NULL;
+	
+	if(!path || !g_file_get_contents(path, &contents, NULL, NULL))
+		return times;
+	
+	gchar **lines = g_strsplit(contents, "\n", -1);
+	
+	for(gchar **line = lines; *line; line++) {
+		gchar **fields = g_strsplit(*line, "\t", 5);
+		
+		if(g_strv_length(fields) == 5 && g_str_equal(fields[1], "NewIcon")
+			&& g_str_equal(fields[3], SNI_OBJECT_PATH))
+		{
+			gint64 t = g_ascii_strtoll(fields[0], NULL, 10);
+			g_array_append_val(times, t);
+		}
+		
+		g_strfreev(fields);
+	}
+	
+	g_strfreev(lines);
+	g_free(contents);
+	
+	return times;
+}
+
+/* The plugin's flight recorder, oldest record first. The strings
+ * point into *ret, which the caller has to unref after the records. */
+static GArray *dump_trace(GDBusConnection *bus, GVariant **ret) {
+	GError *error = NULL;
+	GVariantIter *iter;
+	record_t r;
+	
+	*ret = g_dbus_connection_call_sync(bus, DBUS_SERVICE_NAME,
+		API_OBJECT_PATH, API_INTERFACE, "DumpTrace", NULL,
+		G_VARIANT_TYPE("(a(xssiii))"), G_DBUS_CALL_FLAGS_NONE,
+		CALL_TIMEOUT_MS, NULL, &error);
+	
+	if(!*ret) {
+		fprintf(stderr, "etray-bench: can't get the trace: %s\n", error->message);
+		g_error_free(error);
+		return NULL;
+	}
+	
+	GArray *records = g_array_new(FALSE, FALSE, sizeof(record_t));
+	
+	g_variant_get(*ret, "(a(xssiii))", &iter);
+	while(g_variant_iter_next(iter, "(x&s&siii)", &r.time, &r.type, &r.what, &r.a, &r.b, &r.c))
+		g_array_append_val(records, r);
+	g_variant_iter_free(iter);
+	
+	return records;
+}
+
+static int cmd_report(const gchar *watcher_log, gint64 since) {
+	GVariant *ret;
+	
+	GDBusConnection *bus = get_bus();
+	if(!bus) return 1;
+	
+	GArray *records = dump_trace(bus, &ret);
+	
+	if(!records) {
+		g_object_unref(bus);
+		return 1;
+	}
+	
+	GArray *new_icons = read_new_icons(watcher_log);
+	GArray *latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+	
+	printf("{\n  \"init_stages\": [");
+	
+	gint64 init_total = -1;
+	gboolean first = TRUE;
+	
+	for(guint i = 0; i < records->len; i++) {
+		record_t *rec = &g_array_index(records, record_t, i);
+		
+		if(!g_str_equal(rec->type, "init"))
+			continue;
+		
+		printf("%s\n    {\"stage\": \"%s\", \"us\": %d}", first ? "" : ",", rec->what, rec->a);
+		
+		init_total = rec->b;
+		first = FALSE;
+	}
+	
+	printf("\n  ],\n  \"init_total_us\": %" G_GINT64_FORMAT ",\n", init_total);
+	printf("  \"events\": [");
+	
+	/* Every read -> unread transition happens inside an unread-updated
+	 * handler, which is recorded (with its duration) once it returns. */
+	first = TRUE;
+	guint next_icon = 0;
+	
+	for(guint i = 0; i < records->len; i++) {
+		record_t *rec = &g_array_index(records, record_t, i);
+		
+		if(rec->time < since || !g_str_equal(rec->type, "status")
+			|| !g_str_equal(rec->what, "unread"))
+		{
+			continue;
+		}
+		
+		gint64 start = -1;
+		
+		for(guint j = i + 1; j < records->len; j++) {
+			record_t *handler = &g_array_index(records, record_t, j);
+			
+			if(g_str_equal(handler->type, "handler")
+				&& g_str_equal(handler->what, "unread-updated"))
+			{
+				start = handler->time - handler->a;
+				break;
+			}
+		}
+		
+		if(start < 0)
+			continue;
+		
+		while(next_icon < new_icons->len
+			&& g_array_index(new_icons, gint64, next_icon) < start)
+		{
+			next_icon++;
+		}
+		
+		if(next_icon == new_icons->len)
+			break;
+		
+		gint64 icon = g_array_index(new_icons, gint64, next_icon++);
+		gint64 latency = icon - start;
+		
+		printf("%s\n    {\"unread_updated\": %" G_GINT64_FORMAT ", \"new_icon\": %"
+			G_GINT64_FORMAT ", \"latency_us\": %" G_GINT64_FORMAT "}",
+			first ? "" : ",", start, icon, latency);
+		
+		g_array_append_val(latencies, latency);
+		first = FALSE;
+	}
+	
+	printf("\n  ],\n  \"latency_us\": {\"n\": %u", latencies->len);
+	
+	if(latencies->len > 0) {
+		g_array_sort(latencies, compare_gint64);
+		
+		gint64 *l = (gint64 *) latencies->data;
+		guint n = latencies->len;
+		
+		printf(", \"min\": %" G_GINT64_FORMAT ", \"median\": %" G_GINT64_FORMAT
+			", \"p90\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT,
+			l[0], l[n / 2], l[MIN(n - 1, n * 9 / 10)], l[n - 1]);
+	}
+	
+	printf("}\n}\n");
+	
+	g_array_unref(latencies);
+	g_array_unref(new_icons);
+	g_array_unref(records);
+	g_variant_unref(ret);
+	g_object_unref(bus);
+	
+	return 0;
+}
+
+/* Whether the adaptive refresh ran on the scheduler's timing: at least
+ * expected refreshes since the given time, each one when the timer armed
+ * last before it was set to fire, with a next interval within the bounds,
+ * and never two closer than the shortest interval. Prints them as JSON,
+ * and fails if any of that doesn't hold. */
+static int cmd_schedule(gint64 since, gint min_interval, gint max_interval,
+	guint expected)
+{
+	GVariant *ret;
+	
+	GDBusConnection *bus = get_bus();
+	if(!bus) return 1;
+	
+	GArray *records = dump_trace(bus, &ret);
+	
+	if(!records) {
+		g_object_unref(bus);
+		return 1;
+	}
+	
+	const record_t *armed = NULL;
+	gint64 last_refresh = -1;
+	guint count = 0;
+	gboolean ok = TRUE;
+	
+	printf("{\n  \"refreshes\": [");
+	
+	for(guint i = 0; i < records->len; i++) {
+		const record_t *rec = &g_array_index(records, record_t, i);
+		
+		if(!g_str_equal(rec->type, "refresh"))
+			continue;
+		
+		if(g_str_equal(rec->what, "arm")) {
+			armed = rec;
+			continue;
+		}
+		
+		if(!g_str_equal(rec->what, "refresh") || rec->time < since)
+			continue;
+		
+		/* The timer has a resolution of a second, and GLib lines
+		 * such timers up on a whole second, either way. */
+		gint64 late = (armed ? rec->time - armed->time
+			- (gint64) armed->a * G_USEC_PER_SEC : G_MAXINT64);
+		gint64 gap = (last_refresh >= 0 ? rec->time - last_refresh : -1);
+		
+		gboolean on_time = (armed && armed->b && ABS(late) <= SCHEDULE_SLACK_US);
+		gboolean in_bounds = (rec->a >= min_interval && rec->a <= max_interval);
+		gboolean spaced = (gap < 0 || gap >= (gint64) min_interval
+			* G_USEC_PER_SEC - SCHEDULE_SLACK_US);
+		
+		printf("%s\n    {\"time\": %" G_GINT64_FORMAT ", \"late_us\": %" G_GINT64_FORMAT
+			", \"next_interval_s\": %d, \"rate_per_hour\": %.3f, \"on_schedule\": %s}",
+			count ? "," : "", rec->time, armed ? late : -1, rec->a, rec->b / 1000.0,
+			(on_time && in_bounds && spaced) ? "true" : "false");
+		
+		ok = ok && on_time && in_bounds && spaced;
+		last_refresh = rec->time;
+		count++;
+	}
+	
+	ok = ok && count >= expected;
+	
+	printf("\n  ],\n  \"expected\": %u,\n  \"ok\": %s\n}\n",
+		expected, ok ? "true" : "false");
+	
+	g_array_unref(records);
+	g_variant_unref(ret);
+	g_object_unref(bus);
+	
+	return (ok ? 0 : 1);
+}
+
+// -----------------------------
+
+int main(int argc, char *argv[]) {
+	if(argc < 2) {
+		usage(argv[0]);
+		return 2;
+	}
+	
+	const gchar *cmd = argv[1];
+	
+	if(g_str_equal(cmd, "now")) {
+		printf("%" G_GINT64_FORMAT "\n", g_get_monotonic_time());
+		return 0;
+	}
+	
+	if(g_str_equal(cmd, "watcher"))
+		return cmd_watcher();
+	
+	if(g_str_equal(cmd, "menu") && argc == 3)
+		return cmd_menu(argv[2]);
+	
+	if(g_str_equal(cmd, "report")) {
+		const gchar *watcher_log = NULL;
+		gint64 since = 0;
+		int opt;
+		
+		optind = 2;
+		
+		while((opt = getopt(argc, argv, "w:s:h")) != -1) {
+			switch(opt) {
+				case 'w': watcher_log = optarg; break;
+				case 's': since = g_ascii_strtoll(optarg, NULL, 10); break;
+				default:
+					usage(argv[0]);
+					return (opt == 'h' ? 0 : 2);
+			}
+		}
+		
+		return cmd_report(watcher_log, since);
+	}
+	
+	if(g_str_equal(cmd, "schedule")) {
+		gint64 since = 0;
+		gint min_interval = 0, max_interval = G_MAXINT;
+		guint expected = 1;
+		int opt;
+		
+		optind = 2;
+		
+		while((opt = getopt(argc, argv, "s:m:M:n:h")) != -1) {
+			switch(opt) {
+				case 's': since = g_ascii_strtoll(optarg, NULL, 10); break;
+				case 'm': min_interval = atoi(optarg); break;
+				case 'M': max_interval = atoi(optarg); break;
+				case 'n': expected = atoi(optarg); break;
+				default:
+					usage(argv[0]);
+					return (opt == 'h' ? 0 : 2);
+			}
+		}
+		
+		return cmd_schedule(since, min_interval, max_interval, expected);
+	}
+	
+	usage(argv[0]);
+	return 2;
+}
@@ -0,0 +1,451 @@
+#!/bin/sh
+# Startup and event latency benchmarks of the plugin, each run in a throwaway
+# session: Xvfb, a private session bus, etray-bench as the tray, and a local
+# account. Prints JSON. See README.md (Benchmarks).
+#
+# Usage: bench/run.sh [-b BUILDDIR] [-n RUNS] [-e EVENTS] [-a ACCOUNT] [-o OUTPUT]
+#   -b BUILDDIR  meson build dir, configured with -Dbench=true (default: build)
+#   -n RUNS      sessions with and without the plugin, each (default: 3)
+#   -e EVENTS    new mail events per session with the plugin (default: 10)
+#   -a ACCOUNT   maildir, or imap for dovecot serving that maildir (default: maildir)
+#   -o OUTPUT    write the JSON there instead of stdout
+#
+# The plugin and its schema must be installed, as Evolution only loads
+# plugins from its plugin directory.
+
+set -eu
+
+builddir=build
+runs=3
+events=10
+account=maildir
+output=
+
+while getopts "b:n:e:a:o:h" opt; do
+	case "$opt" in
+		b) builddir=$OPTARG ;;
+		n) runs=$OPTARG ;;
+		e) events=$OPTARG ;;
+		a) account=$OPTARG ;;
+		o) output=$OPTARG ;;
+		*) sed -n '6,11p' "$0" >&2; exit 2 ;;
+	esac
+done
+
+case "$account" in
+	maildir) servers= ;;
+	imap) servers=dovecot ;;
+	*) sed -n '6,11p' "$0" >&2; exit 2 ;;
+esac
+
+bench=$(realpath "$builddir/bench/etray-bench")
+plugin_id=org.gnome.evolution.plugin.evolution-tray
+
+# Seconds to wait for anything to happen, before giving up on it
+timeout_s=60
+
+# Bounds of the adaptive refresh of the IMAP account, in seconds. Narrow and
+# short, so that the scheduler's timing can be checked in a few minutes.
+refresh_min_s=30
+refresh_max_s=60
+
+for tool in Xvfb dbus-daemon evolution xdotool timeout $servers "$bench"; do
+	if ! command -v "$tool" >/dev/null; then
+		echo "run.sh: $tool not found" >&2
+		exit 1
+	fi
+done
+
+work=$(mktemp -d)
+xvfb_pid=
+bus_pid=
+watcher_pid=
+evo_pid=
+
+tab=$(printf '\t')
+
+# -----------------------------
+
+log() {
+	echo "run.sh: $*" >&2
+}
+
+# Poll until the command succeeds, or give up after $timeout_s (or -t SECONDS)
+wait_for() {
+	limit=$timeout_s
+
+	if [ "$1" = -t ]; then
+		limit=$2
+		shift 2
+	fi
+
+	deadline=$(( $(date +%s) + limit ))
+
+	until "$@"; do
+		if [ "$(date +%s)" -ge "$deadline" ]; then
+			return 1
+		fi
+
+		sleep 0.05
+	done
+}
+
+# The mail account, reading the maildir either directly, or over IMAP. For
+# the latter, Evolution runs dovecot's IMAP server itself, preauthenticated
+# as whoever runs this and talking over a pipe: no port, no daemon and no
+# password, which Evolution would have to prompt for.
+write_account() {
+	case "$account" in
+		maildir)
+			cat <<-EOF
+			[Mail Account]
+			BackendName=maildir
+			IdentityUid=bench-identity
+			NeedsInitialSetup=false
+
+			[Maildir Backend]
+			Path=$maildir
+			FilterInbox=false
+			EOF
+			;;
+		imap)
+			cat > "$home/dovecot.conf" <<-EOF
+			mail_location = maildir:$maildir
+			base_dir = $home/dovecot
+			log_path = $home/dovecot.log
+			ssl = no
+			default_internal_user = $(id -un)
+			default_login_user = $(id -un)
+			EOF
+
+			cat <<-EOF
+			[Mail Account]
+			BackendName=imapx
+			IdentityUid=bench-identity
+			NeedsInitialSetup=false
+
+			[Authentication]
+			Host=localhost
+			User=$(id -un)
+
+			[Imapx Backend]
+			UseShellCommand=true
+			ShellCommand=dovecot -c $home/dovecot.conf --exec-mail imap
+			UseIdle=false
+			FilterInbox=false
+			EOF
+			;;
+	esac
+}
+
+# The accounts, and the settings. The keyfile backend keeps the settings
+# inside the session's home, away from those of whoever runs this. The IMAP
+# account neither idles nor gets checked by Evolution, so it's polled by the
+# plugin's adaptive refresh alone.
+write_config() {
+	with_plugin=$1
+	sources="$XDG_CONFIG_HOME/evolution/sources"
+
+	mkdir -p "$sources" "$XDG_CONFIG_HOME/glib-2.0/settings" \
+		"$maildir/cur" "$maildir/new" "$maildir/tmp"
+
+	if [ "$with_plugin" = 1 ]; then
+		disabled="@as []"
+	else
+		disabled="['$plugin_id']"
+	fi
+
+	cat > "$XDG_CONFIG_HOME/glib-2.0/settings/keyfile" <<-EOF
+	[org/gnome/evolution]
+	disabled-eplugins=$disabled
+	EOF
+
+	if [ "$account" = imap ]; then
+		cat >> "$XDG_CONFIG_HOME/glib-2.0/settings/keyfile" <<-EOF
+
+		[org/gnome/evolution/plugin/evolution-tray]
+		adaptive-refresh=true
+		refresh-min-interval=uint32 $refresh_min_s
+		refresh-max-interval=uint32 $refresh_max_s
+		EOF
+	fi
+
+	{
+		cat <<-EOF
+		[Data Source]
+		DisplayName=Bench
+		Enabled=true
+		Parent=
+
+		EOF
+
+		write_account
+
+		cat <<-EOF
+
+		[Refresh]
+		Enabled=false
+		IntervalMinutes=60
+		EOF
+	} > "$sources/bench-account.source"
+
+	cat > "$sources/bench-identity.source" <<-EOF
+	[Data Source]
+	DisplayName=Bench
+	Enabled=true
+	Parent=bench-account
+
+	[Mail Identity]
+	Address=bench@localhost
+	Name=Bench
+
+	[Mail Submission]
+	TransportUid=bench-transport
+	EOF
+
+	cat > "$sources/bench-transport.source" <<-EOF
+	[Data Source]
+	DisplayName=Bench
+	Enabled=true
+	Parent=bench-account
+
+	[Mail Transport]
+	BackendName=sendmail
+	EOF
+}
+
+# Deliver a new mail to the Inbox, the maildir way
+deliver() {
+	name="$(date +%s).$$_$1.bench"
+
+	cat > "$maildir/tmp/$name" <<-EOF
+	From: Sender $1 <sender$1@localhost>
+	To: Bench <bench@localhost>
+	Subject: Benchmark message $1
+	Date: $(date -R)
+	Message-ID: <$name@localhost>
+
+	Message $1.
+	EOF
+
+	mv "$maildir/tmp/$name" "$maildir/new/$name"
+}
+
+watcher_has() {
+	grep -q "$1" "$home/watcher.log"
+}
+
+# Number of NewIcon signals of the main item that reached the watcher
+count_icons() {
+	grep -c "${tab}NewIcon${tab}[^$tab]*${tab}/StatusNotifierItem${tab}" \
+		"$home/watcher.log" || true
+}
+
+icons_reached() {
+	[ "$(count_icons)" -ge "$1" ]
+}
+
+evolution_gone() {
+	! kill -0 "$evo_pid" 2>/dev/null
+}
+
+# -----------------------------
+
+session_start() {
+	home="$work/$1"
+	maildir="$home/Maildir"
+
+	mkdir -p "$home/run"
+	chmod 700 "$home/run"
+
+	export HOME="$home"
+	export XDG_CONFIG_HOME="$home/.config"
+	export XDG_DATA_HOME="$home/.local/share"
+	export XDG_CACHE_HOME="$home/.cache"
+	export XDG_RUNTIME_DIR="$home/run"
+	export GSETTINGS_BACKEND=keyfile
+
+	write_config "$2"
+
+	Xvfb -displayfd 3 -screen 0 1280x1024x24 -nolisten tcp \
+		3>"$home/display" >/dev/null 2>&1 &
+	xvfb_pid=$!
+
+	if ! wait_for test -s "$home/display"; then
+		log "Xvfb didn't start"
+		exit 1
+	fi
+
+	export DISPLAY=":$(cat "$home/display")"
+
+	dbus-daemon --session --fork --print-address=3 --print-pid=4 \
+		3>"$home/bus.address" 4>"$home/bus.pid"
+	bus_pid=$(cat "$home/bus.pid")
+
+	export DBUS_SESSION_BUS_ADDRESS="$(cat "$home/bus.address")"
+
+	"$bench" watcher > "$home/watcher.log" &
+	watcher_pid=$!
+
+	if ! wait_for watcher_has "${tab}watcher${tab}"; then
+		log "etray-bench watcher didn't start, see $home/watcher.log"
+		exit 1
+	fi
+}
+
+# Launch Evolution, and set startup to how long it took for its
+# window to show up, in microseconds
+start_evolution() {
+	start=$("$bench" now)
+
+	evolution > "$home/evolution.log" 2>&1 &
+	evo_pid=$!
+
+	if ! timeout "$timeout_s" xdotool search --sync --onlyvisible \
+		--class '^[Ee]volution$' >/dev/null
+	then
+		log "Evolution's window didn't show up, see $home/evolution.log"
+		exit 1
+	fi
+
+	startup=$(( $("$bench" now) - start ))
+}
+
+session_stop() {
+	if [ -n "$evo_pid" ]; then
+		evolution --quit >/dev/null 2>&1 || true
+		wait_for evolution_gone || kill "$evo_pid" 2>/dev/null || true
+		wait "$evo_pid" 2>/dev/null || true
+	fi
+
+	[ -n "$watcher_pid" ] && kill "$watcher_pid" 2>/dev/null || true
+	[ -n "$bus_pid" ] && kill "$bus_pid" 2>/dev/null || true
+	[ -n "$xvfb_pid" ] && kill "$xvfb_pid" 2>/dev/null || true
+
+	evo_pid= watcher_pid= bus_pid= xvfb_pid=
+}
+
+cleanup() {
+	session_stop
+	rm -rf "$work"
+}
+
+trap cleanup EXIT
+trap 'exit 130' INT TERM
+
+# -----------------------------
+
+# Read -> unread on new mail, and back on Mark as Seen, each a NewIcon. The
+# maildir is checked on demand, the IMAP account only when the adaptive
+# refresh gets to it, which may take up to its longest interval.
+run_events() {
+	icon_timeout_s=$timeout_s
+	[ "$account" = imap ] && icon_timeout_s=$((timeout_s + refresh_max_s))
+
+	i=1
+
+	while [ "$i" -le "$events" ]; do
+		icons=$(count_icons)
+
+		deliver "$i"
+		[ "$account" = imap ] || "$bench" menu "Send / Receive"
+
+		if ! wait_for -t "$icon_timeout_s" icons_reached $((icons + 1)); then
+			log "no icon change for message $i"
+			return
+		fi
+
+		"$bench" menu "Mark New Mail as Seen"
+		wait_for icons_reached $((icons + 2)) || log "icon stuck on unread"
+
+		i=$((i + 1))
+	done
+}
+
+baseline=
+plugin=
+reports=
+schedules=
+
+for run in $(seq 1 "$runs"); do
+	log "run $run/$runs: without the plugin"
+
+	session_start "baseline-$run" 0
+	start_evolution
+	session_stop
+
+	baseline="$baseline${baseline:+, }$startup"
+
+	log "run $run/$runs: with the plugin"
+
+	session_start "plugin-$run" 1
+	start_evolution
+
+	if ! wait_for watcher_has "${tab}register${tab}$plugin_id${tab}"; then
+		log "the plugin didn't register its tray icon, is it installed?"
+		exit 1
+	fi
+
+	# Let the startup unread counts come in, they're not what we measure
+	sleep 2
+
+	since=$("$bench" now)
+	run_events
+
+	"$bench" report -w "$home/watcher.log" -s "$since" > "$work/report-$run.json"
+
+	# Every new mail was picked up by a refresh, all on the scheduler's timing
+	if [ "$account" = imap ]; then
+		if ! "$bench" schedule -s "$since" -m "$refresh_min_s" \
+			-M "$refresh_max_s" -n "$events" > "$work/schedule-$run.json"
+		then
+			log "the adaptive refresh was off schedule:"
+			cat "$work/schedule-$run.json" >&2
+			exit 1
+		fi
+
+		schedules="$schedules $work/schedule-$run.json"
+	fi
+
+	session_stop
+
+	plugin="$plugin${plugin:+, }$startup"
+	reports="$reports $work/report-$run.json"
+done
+
+emit() {
+	printf '{\n  "runs": %s,\n  "events_per_run": %s,\n' "$runs" "$events"
+	printf '  "startup_us": {\n    "baseline": [%s],\n    "plugin": [%s]\n  },\n' \
+		"$baseline" "$plugin"
+	printf '  "plugin_runs": [\n'
+
+	sep=
+	for report in $reports; do
+		printf '%s' "$sep"
+		cat "$report"
+		sep=','
+	done
+
+	printf '  ]'
+
+	if [ -n "$schedules" ]; then
+		printf ',\n  "refresh_schedule": [\n'
+
+		sep=
+		for schedule in $schedules; do
+			printf '%s' "$sep"
+			cat "$schedule"
+			sep=','
+		done
+
+		printf '  ]'
+	fi
+
+	printf '\n}\n'
+}
+
+if [ -n "$output" ]; then
+	emit > "$output"
+else
+	emit
+fi
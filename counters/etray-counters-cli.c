@@ -0,0 +1,130 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Print the counters published by the plugin, once or on every change.
+ * Meant for status bars that take their input from a command. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "etray-counters.h"
+
+static void usage(const char *prog) {
+	fprintf(stderr, "Usage: %s [-f FILE] [-w MSEC] [-j]\n"
+		"  -f FILE  counter page (default: $XDG_RUNTIME_DIR/%s,\n"
+		"           or in $XDG_CACHE_HOME or ~/.cache without it)\n"
+		"  -w MSEC  keep running, print on every change, polling every MSEC\n"
+		"           (waiting for the plugin, when it goes away)\n"
+		"  -j       print JSON instead of 'unread new status'\n",
+		prog, ETRAY_COUNTERS_FILENAME);
+}
+
+/* Wait for the plugin to publish a (new) page, and take a first snapshot
+ * of it. A restarted plugin creates a new file, even at the same path. */
+static etray_counters_reader *reopen(const char *path,
+	const struct timespec *ts, etray_counters *c)
+{
+	for(;;) {
+		nanosleep(ts, NULL);
+		
+		etray_counters_reader *reader = etray_counters_open(path);
+		
+		if(reader && etray_counters_read(reader, c) == 0)
+			return reader;
+		
+		etray_counters_close(reader);
+	}
+}
+
+static void print(const etray_counters *c, int json) {
+	const char *status = (c->status == ETRAY_STATUS_UNREAD ? "unread" : "read");
+	
+	if(json) {
+		printf("{\"unread\": %u, \"new\": %u, \"status\": \"%s\"}\n",
+			c->unread, c->new_count, status);
+	} else
+		printf("%u %u %s\n", c->unread, c->new_count, status);
+	
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+	const char *path = NULL;
+	long interval_ms = -1;
+	int json = 0;
+	int opt;
+	
+	while((opt = getopt(argc, argv, "f:w:jh")) != -1) {
+		switch(opt) {
+			case 'f': path = optarg; break;
+			case 'w': interval_ms = strtol(optarg, NULL, 10); break;
+			case 'j': json = 1; break;
+			default:
+				usage(argv[0]);
+				return (opt == 'h' ? 0 : 2);
+		}
+	}
+	
+	etray_counters_reader *reader = etray_counters_open(path);
+	
+	if(!reader) {
+		fprintf(stderr, "%s: can't open counter page: %s\n",
+			argv[0], strerror(errno));
+		return 1;
+	}
+	
+	etray_counters c;
+	
+	if(etray_counters_read(reader, &c) != 0) {
+		fprintf(stderr, "%s: counter page is not valid\n", argv[0]);
+		etray_counters_close(reader);
+		return 1;
+	}
+	
+	print(&c, json);
+	
+	if(interval_ms > 0) {
+		struct timespec ts = {
+			.tv_sec = interval_ms / 1000,
+			.tv_nsec = (interval_ms % 1000) * 1000000
+		};
+		
+		for(;;) {
+			nanosleep(&ts, NULL);
+			
+			if(!etray_counters_changed(reader))
+				continue;
+			
+			// The plugin went away, wait for it to come back
+			if(etray_counters_read(reader, &c) != 0) {
+				etray_counters_close(reader);
+				reader = reopen(path, &ts, &c);
+			}
+			
+			print(&c, json);
+		}
+	}
+	
+	etray_counters_close(reader);
+	
+	return 0;
+}
@@ -0,0 +1,161 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Reader side of the counter page, see etray-counters.h. Deliberately
+ * free of any dependencies, so that it can be used from anywhere. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "etray-counters.h"
+
+// Give up on a snapshot after this many collisions with the writer
+#define MAX_RETRIES 1000
+
+struct etray_counters_reader {
+	const etray_counters_page *page;
+	size_t size;
+	
+	uint32_t last_seq;
+};
+
+etray_counters_reader *etray_counters_open(const char *path) {
+	char default_path[PATH_MAX];
+	struct stat st;
+	
+	if(!path) {
+		/* Wherever the plugin put it: g_get_user_runtime_dir(), which
+		 * falls back to g_get_user_cache_dir() without XDG_RUNTIME_DIR */
+		const char *dir = getenv("XDG_RUNTIME_DIR");
+		const char *subdir = "";
+		
+		if(!dir || !*dir)
+			dir = getenv("XDG_CACHE_HOME");
+		
+		if(!dir || !*dir) {
+			dir = getenv("HOME");
+			subdir = "/.cache";
+		}
+		
+		if(!dir || !*dir) {
+			errno = ENOENT;
+			return NULL;
+		}
+		
+		int len = snprintf(default_path, sizeof(default_path), "%s%s/%s",
+			dir, subdir, ETRAY_COUNTERS_FILENAME);
+		
+		if(len < 0 || (size_t) len >= sizeof(default_path)) {
+			errno = ENAMETOOLONG;
+			return NULL;
+		}
+		
+		path = default_path;
+	}
+	
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd == -1) return NULL;
+	
+	if(fstat(fd, &st) == -1) {
+		close(fd);
+		return NULL;
+	}
+	
+	if((size_t) st.st_size < sizeof(etray_counters_page)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	
+	if(map == MAP_FAILED)
+		return NULL;
+	
+	etray_counters_reader *reader = malloc(sizeof(*reader));
+	
+	if(!reader) {
+		munmap(map, st.st_size);
+		errno = ENOMEM;
+		return NULL;
+	}
+	
+	*reader = (etray_counters_reader) {
+		.page = map,
+		.size = st.st_size,
+		.last_seq = 0
+	};
+	
+	return reader;
+}
+
+void etray_counters_close(etray_counters_reader *reader) {
+	if(!reader) return;
+	
+	munmap((void *) reader->page, reader->size);
+	free(reader);
+}
+
+int etray_counters_read(etray_counters_reader *reader, etray_counters *out) {
+	const etray_counters_page *page = reader->page;
+	
+	/* The plugin clears the magic when it stops publishing. The version
+	 * can't change under our feet, a new writer means a new file. */
+	if(__atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != ETRAY_COUNTERS_MAGIC
+		|| page->version != ETRAY_COUNTERS_VERSION)
+	{
+		return -1;
+	}
+	
+	for(int i = 0; i < MAX_RETRIES; i++) {
+		uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		
+		// Writer in progress
+		if(seq & 1)
+			continue;
+		
+		out->unread = __atomic_load_n(&page->unread, __ATOMIC_RELAXED);
+		out->new_count = __atomic_load_n(&page->new_count, __ATOMIC_RELAXED);
+		out->status = __atomic_load_n(&page->status, __ATOMIC_RELAXED);
+		out->updated_us = __atomic_load_n(&page->updated_us, __ATOMIC_RELAXED);
+		
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		
+		if(__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq) {
+			reader->last_seq = seq;
+			return 0;
+		}
+	}
+	
+	return -1;
+}
+
+// A page that's no longer valid counts as changed, the read will tell
+int etray_counters_changed(etray_counters_reader *reader) {
+	const etray_counters_page *page = reader->page;
+	
+	return __atomic_load_n(&page->seq, __ATOMIC_RELAXED) != reader->last_seq
+		|| __atomic_load_n(&page->magic, __ATOMIC_RELAXED) != ETRAY_COUNTERS_MAGIC;
+}
@@ -0,0 +1,89 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef ETRAY_COUNTERS_H
+#define ETRAY_COUNTERS_H
+
+/* The counter page, a small file under $XDG_RUNTIME_DIR that the plugin
+ * keeps mmapped and updates in place. Readers map it once, and can then
+ * poll it as often as they like, with no syscalls and no bus traffic.
+ *
+ * Consistency is ensured with a seqlock: the writer makes the sequence
+ * number odd before it touches the data and even again after. A reader
+ * that sees an odd sequence, or a different one before and after reading
+ * the data, raced with the writer and simply has to try again. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ETRAY_COUNTERS_FILENAME "evolution-tray.counters"
+#define ETRAY_COUNTERS_MAGIC 0x59415254u // "TRAY"
+#define ETRAY_COUNTERS_VERSION 1
+
+enum {
+	ETRAY_STATUS_READ = 0,
+	ETRAY_STATUS_UNREAD = 1
+};
+
+/* The shared layout. All fields are accessed atomically. Appending fields
+ * is fine, anything else must bump ETRAY_COUNTERS_VERSION. */
+typedef struct etray_counters_page {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;
+	
+	uint32_t unread;
+	uint32_t new_count;
+	uint32_t status;
+	
+	// CLOCK_MONOTONIC, in microseconds
+	uint64_t updated_us;
+} etray_counters_page;
+
+typedef struct etray_counters {
+	uint32_t unread;
+	uint32_t new_count;
+	uint32_t status;
+	uint64_t updated_us;
+} etray_counters;
+
+typedef struct etray_counters_reader etray_counters_reader;
+
+/* Returns NULL and sets errno on failure. A NULL path means
+ * $XDG_RUNTIME_DIR/ETRAY_COUNTERS_FILENAME, or without XDG_RUNTIME_DIR,
+ * the same under $XDG_CACHE_HOME (or ~/.cache), like the plugin does. */
+etray_counters_reader *etray_counters_open(const char *path);
+void etray_counters_close(etray_counters_reader *reader);
+
+/* Take a consistent snapshot. Doesn't make any syscalls. Returns
+ * 0 on success, -1 if the page isn't (or is no longer) valid. */
+int etray_counters_read(etray_counters_reader *reader, etray_counters *out);
+
+/* Check whether anything changed since the last read, without taking a
+ * snapshot. Even cheaper than etray_counters_read(). Also true once the
+ * plugin has stopped publishing, which the next read then reports. */
+int etray_counters_changed(etray_counters_reader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ETRAY_COUNTERS_H */
@@ -0,0 +1,367 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Access to the mail accounts (i.e. the CamelStores of the mail session).
+ *
+ * At startup, we seed the ucount table with the unread count of every
+ * folder of every enabled account, so that ucount knows the baseline of
+ * each folder before the first unread event arrives. Fetching the folder
+ * info of a store may well involve a round-trip to the server, so we fire
+ * one async job per store, all at once, and let them run concurrently in
+ * camel's thread pool. The results are collected in the main thread and
+ * handed over in a single batch, once the last job has finished.
+ *
+ * We also watch the source registry, to let ucount know when an account is
+ * disabled or removed, so that its folders stop counting. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gio/gio.h>
+#include <glib/gprintf.h>
+
+#include <shell/e-shell.h>
+#include <mail/e-mail-backend.h>
+#include <mail/mail-send-recv.h>
+
+#include "accounts.h"
+
+typedef struct seed_job_t {
+	GCancellable *cancellable;
+	GArray *seeds;
+	guint pending;
+	
+	// The ucount epoch when we started, see ucount_seed()
+	guint64 epoch;
+	
+	void (*seeded_cb)(const ucount_seed_t *seeds, guint n_seeds,
+		guint64 epoch);
+} seed_job_t;
+
+// The seed job in progress, if any
+static seed_job_t *seed_job = NULL;
+
+static ESourceRegistry *registry = NULL;
+static void (*global_account_removed_cb)(const gchar *account) = NULL;
+
+// -----------------------------
+
+EMailSession *accounts_get_session(void) {
+	EShell *shell = e_shell_get_default();
+	if(!shell) return NULL;
+	
+	EShellBackend *backend = e_shell_get_backend_by_name(shell, "mail");
+	if(!backend) return NULL;
+	
+	return e_mail_backend_get_session(E_MAIL_BACKEND(backend));
+}
+
+/* The account part of the folder URIs of the store with the given UID.
+ * Same escaping as in e_mail_folder_uri_build(). Free with g_free(). */
+gchar *accounts_folder_uri_account(const gchar *uid) {
+	return camel_url_encode(uid, ":;@/");
+}
+
+/* The stores of all enabled accounts, excluding the search folders.
+ * Free with g_list_free_full(list, g_object_unref). */
+GList *accounts_ref_stores(void) {
+	EMailSession *session = accounts_get_session();
+	if(!session) return NULL;
+	
+	ESourceRegistry *registry = e_mail_session_get_registry(session);
+	GList *services = camel_session_list_services(CAMEL_SESSION(session));
+	GList *stores = NULL;
+	
+	for(GList *l = services; l != NULL; l = g_list_next(l)) {
+		CamelService *service = CAMEL_SERVICE(l->data);
+		const gchar *uid = camel_service_get_uid(service);
+		
+		if(!CAMEL_IS_STORE(service))
+			continue;
+		
+		if(g_strcmp0(uid, E_MAIL_SESSION_VFOLDER_UID) == 0)
+			continue;
+		
+		ESource *source = e_source_registry_ref_source(registry, uid);
+		gboolean enabled = (source && e_source_registry_check_enabled(registry, source));
+		g_clear_object(&source);
+		
+		if(enabled)
+			stores = g_list_prepend(stores, g_object_ref(service));
+	}
+	
+	g_list_free_full(services, g_object_unref);
+	
+	return g_list_reverse(stores);
+}
+
+/* Send the outbox and check all enabled accounts for new mail. Unlike the
+ * Send/Receive action of the shell window, this doesn't pop up the progress
+ * dialog, nor does it need the main window to exist, let alone be visible. */
+void accounts_send_receive(void) {
+	EMailSession *session = accounts_get_session();
+	if(!session) return;
+	
+	GList *stores = accounts_ref_stores();
+	
+	for(GList *l = stores; l != NULL; l = g_list_next(l)) {
+		CamelService *service = CAMEL_SERVICE(l->data);
+		
+		// Nothing to receive for 'On This Computer'
+		if(g_strcmp0(camel_service_get_uid(service), E_MAIL_SESSION_LOCAL_UID) == 0)
+			continue;
+		
+		mail_receive_account(session, service);
+	}
+	
+	g_list_free_full(stores, g_object_unref);
+	
+	mail_send(session);
+}
+
+/* Whether new mail only shows up in the store when it's checked: a remote
+ * store, with neither IMAP IDLE, nor Evolution's own periodic check on. */
+gboolean accounts_store_is_polled(CamelStore *store) {
+	CamelService *service = CAMEL_SERVICE(store);
+	CamelProvider *provider = camel_service_get_provider(service);
+	
+	if(!provider || !(provider->flags & CAMEL_PROVIDER_IS_REMOTE))
+		return FALSE;
+	
+	if(registry) {
+		ESource *source = e_source_registry_ref_source(registry,
+			camel_service_get_uid(service));
+		gboolean refresh_enabled = FALSE;
+		
+		if(source && e_source_has_extension(source, E_SOURCE_EXTENSION_REFRESH)) {
+			refresh_enabled = e_source_refresh_get_enabled(
+				e_source_get_extension(source, E_SOURCE_EXTENSION_REFRESH));
+		}
+		
+		g_clear_object(&source);
+		
+		if(refresh_enabled)
+			return FALSE;
+	}
+	
+	/* CamelIMAPXSettings is private to its provider,
+	 * go through the property instead of the type. */
+	CamelSettings *settings = camel_service_ref_settings(service);
+	gboolean use_idle = FALSE;
+	
+	if(settings && g_object_class_find_property(
+		G_OBJECT_GET_CLASS(settings), "use-idle"))
+	{
+		g_object_get(settings, "use-idle", &use_idle, NULL);
+	}
+	
+	g_clear_object(&settings);
+	
+	return !use_idle;
+}
+
+// Check a single account for new mail, like accounts_send_receive() does
+void accounts_receive(const gchar *uid) {
+	EMailSession *session = accounts_get_session();
+	if(!session) return;
+	
+	CamelService *service = camel_session_ref_service(CAMEL_SESSION(session), uid);
+	if(!service) return;
+	
+	mail_receive_account(session, service);
+	g_object_unref(service);
+}
+
+/* The sender (name, or address) and subject of a message, as found in its
+ * folder's summary. Only for folders that are open already: nothing gets
+ * opened, and nothing goes over the network. Free both with g_free(). */
+gboolean accounts_describe_message(const gchar *folder_uri, const gchar *uid,
+	gchar **sender, gchar **subject)
+{
+	EMailSession *session = accounts_get_session();
+	if(!session) return FALSE;
+	
+	CamelStore *store = NULL;
+	gchar *folder_name = NULL;
+	
+	if(!e_mail_folder_uri_parse(CAMEL_SESSION(session), folder_uri,
+		&store, &folder_name, NULL))
+	{
+		return FALSE;
+	}
+	
+	MailFolderCache *cache = e_mail_session_get_folder_cache(session);
+	CamelFolder *folder = mail_folder_cache_ref_folder(cache, store, folder_name);
+	CamelMessageInfo *info = (folder ? camel_folder_get_message_info(folder, uid) : NULL);
+	
+	if(info) {
+		CamelInternetAddress *address = camel_internet_address_new();
+		const gchar *from = camel_message_info_get_from(info);
+		const gchar *name = NULL, *email = NULL;
+		
+		if(from && camel_address_decode(CAMEL_ADDRESS(address), from) > 0)
+			camel_internet_address_get(address, 0, &name, &email);
+		
+		*sender = g_strdup(name && *name ? name : (email ? email : from));
+		*subject = g_strdup(camel_message_info_get_subject(info));
+		
+		g_object_unref(address);
+		g_object_unref(info);
+	}
+	
+	g_clear_object(&folder);
+	g_object_unref(store);
+	g_free(folder_name);
+	
+	return (info != NULL);
+}
+
+// -----------------------------
+
+static void seed_job_free(seed_job_t *job) {
+	for(guint i = 0; i < job->seeds->len; i++)
+		g_free(g_array_index(job->seeds, ucount_seed_t, i).folder);
+	
+	g_array_free(job->seeds, TRUE);
+	g_object_unref(job->cancellable);
+	g_free(job);
+}
+
+static void collect_folder_info(GArray *seeds,
+	CamelStore *store, CamelFolderInfo *fi)
+{
+	for(; fi != NULL; fi = fi->next) {
+		// -1 means that the store doesn't know
+		if(fi->unread >= 0 && !(fi->flags & CAMEL_FOLDER_NOSELECT)) {
+			ucount_seed_t seed = {
+				.folder = e_mail_folder_uri_build(store, fi->full_name),
+				.count = fi->unread
+			};
+			
+			g_array_append_val(seeds, seed);
+		}
+		
+		collect_folder_info(seeds, store, fi->child);
+	}
+}
+
+static void on_folder_info_ready(GObject *source,
+	GAsyncResult *result, gpointer user_data)
+{
+	seed_job_t *job = user_data;
+	CamelStore *store = CAMEL_STORE(source);
+	GError *error = NULL;
+	
+	CamelFolderInfo *fi = camel_store_get_folder_info_finish(store, result, &error);
+	
+	if(fi) {
+		collect_folder_info(job->seeds, store, fi);
+		camel_folder_info_free(fi);
+	} else if(error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_printerr("Evolution Tray: Failed to get folder info for '%s': %s\n",
+			camel_service_get_display_name(CAMEL_SERVICE(store)), error->message);
+	}
+	
+	g_clear_error(&error);
+	
+	if(--job->pending > 0)
+		return;
+	
+	if(!g_cancellable_is_cancelled(job->cancellable)) {
+		job->seeded_cb((const ucount_seed_t *) job->seeds->data, job->seeds->len,
+			job->epoch);
+		seed_job = NULL;
+	}
+	
+	seed_job_free(job);
+}
+
+/* Asynchronously fetch the unread counts of all folders of all enabled
+ * accounts. When all of them are in, the callback is invoked once, from
+ * the main thread. Not invoked at all if accounts_fini() comes first. */
+void accounts_seed(void (*seeded_cb)(const ucount_seed_t *seeds,
+	guint n_seeds, guint64 epoch))
+{
+	if(seed_job)
+		return;
+	
+	GList *stores = accounts_ref_stores();
+	if(!stores) return;
+	
+	seed_job_t *job = g_new0(seed_job_t, 1);
+	job->cancellable = g_cancellable_new();
+	job->seeds = g_array_new(FALSE, FALSE, sizeof(ucount_seed_t));
+	job->seeded_cb = seeded_cb;
+	job->epoch = ucount_get_epoch();
+	job->pending = g_list_length(stores);
+	
+	seed_job = job;
+	
+	for(GList *l = stores; l != NULL; l = g_list_next(l)) {
+		camel_store_get_folder_info(CAMEL_STORE(l->data), NULL,
+			CAMEL_STORE_FOLDER_INFO_RECURSIVE | CAMEL_STORE_FOLDER_INFO_SUBSCRIBED,
+			G_PRIORITY_DEFAULT, job->cancellable, on_folder_info_ready, job);
+	}
+	
+	g_list_free_full(stores, g_object_unref);
+}
+
+// -----------------------------
+
+static void on_source_gone(ESourceRegistry *reg,
+	ESource *source, gpointer user_data)
+{
+	if(!e_source_has_extension(source, E_SOURCE_EXTENSION_MAIL_ACCOUNT))
+		return;
+	
+	gchar *account = accounts_folder_uri_account(e_source_get_uid(source));
+	global_account_removed_cb(account);
+	g_free(account);
+}
+
+gint accounts_init(void (*account_removed_cb)(const gchar *account)) {
+	EMailSession *session = accounts_get_session();
+	if(!session) return -1;
+	
+	registry = g_object_ref(e_mail_session_get_registry(session));
+	global_account_removed_cb = account_removed_cb;
+	
+	g_signal_connect(registry, "source-disabled",
+		G_CALLBACK(on_source_gone), NULL);
+	g_signal_connect(registry, "source-removed",
+		G_CALLBACK(on_source_gone), NULL);
+	
+	return 0;
+}
+
+void accounts_fini(void) {
+	/* The job frees itself, when the last
+	 * (now cancelled) folder info call returns. */
+	if(seed_job) {
+		g_cancellable_cancel(seed_job->cancellable);
+		seed_job = NULL;
+	}
+	
+	if(registry) {
+		g_signal_handlers_disconnect_by_func(registry, on_source_gone, NULL);
+		g_clear_object(&registry);
+	}
+	
+	global_account_removed_cb = NULL;
+}
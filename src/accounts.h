@@ -0,0 +1,25 @@
+#ifndef EVOLUTION_TRAY_ACCOUNTS_H
+#define EVOLUTION_TRAY_ACCOUNTS_H
+
+#include <libemail-engine/libemail-engine.h>
+
+#include "ucount.h"
+
+gint accounts_init(void (*account_removed_cb)(const gchar *account));
+void accounts_fini(void);
+
+EMailSession *accounts_get_session(void);
+gchar *accounts_folder_uri_account(const gchar *uid);
+GList *accounts_ref_stores(void);
+
+void accounts_send_receive(void);
+gboolean accounts_store_is_polled(CamelStore *store);
+void accounts_receive(const gchar *uid);
+
+gboolean accounts_describe_message(const gchar *folder_uri, const gchar *uid,
+	gchar **sender, gchar **subject);
+
+void accounts_seed(void (*seeded_cb)(const ucount_seed_t *seeds,
+	guint n_seeds, guint64 epoch));
+
+#endif /* EVOLUTION_TRAY_ACCOUNTS_H */
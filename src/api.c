@@ -0,0 +1,258 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* A small D-Bus interface for other programs (status bars, scripts, ...)
+ * that want to know about unread mail, exported on the same connection and
+ * under the same bus name as the StatusNotifierItem.
+ *
+ * GetCounts(offset, limit) returns the aggregate counts and a page of the
+ * per-folder counts and checkpoints, as kept by ucount. Pages are taken from
+ * ucount's insertion order, which is stable, so walking through all folders
+ * with increasing offsets works as expected.
+ *
+ * CountsChanged is emitted when the aggregate counts change. Bursts of
+ * events (e.g. during a Send/Receive) are coalesced into a single signal,
+ * and nothing is emitted if the counts end up where they were.
+ *
+ * DumpTrace returns the contents of the flight recorder (see trace.c),
+ * oldest record first. Times are CLOCK_MONOTONIC, in microseconds.
+ * 
+ * GetBackgroundStats reports on background mode: the memory given back
+ * by the last main window release, in KiB, and the time it took to
+ * rebuild the window the last time, in microseconds (-1 if unknown). */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gio/gio.h>
+#include <glib/gprintf.h>
+
+#include "api.h"
+#include "ucount.h"
+#include "trace.h"
+
+// Max number of folders returned by a single GetCounts call
+#define MAX_PAGE_SIZE 512
+
+// Window in which changes are gathered into one CountsChanged signal
+#define COALESCE_MS 250
+
+static const gchar introspection_xml[] =
+"<node>"
+"  <interface name='" API_INTERFACE "'>"
+"	<method name='GetCounts'>"
+"	  <arg type='u' name='offset' direction='in'/>"
+"	  <arg type='u' name='limit' direction='in'/>"
+"	  <arg type='u' name='unread' direction='out'/>"
+"	  <arg type='u' name='new' direction='out'/>"
+"	  <arg type='u' name='n_folders_new' direction='out'/>"
+"	  <arg type='u' name='n_folders' direction='out'/>"
+"	  <arg type='a(suu)' name='folders' direction='out'/>"
+"	</method>"
+"	<method name='DumpTrace'>"
+"	  <arg type='a(xssiii)' name='records' direction='out'/>"
+"	</method>"
+"	<method name='GetBackgroundStats'>"
+"	  <arg type='x' name='rss_saved_kib' direction='out'/>"
+"	  <arg type='x' name='rebuild_latency_us' direction='out'/>"
+"	</method>"
+"	<signal name='CountsChanged'>"
+"	  <arg type='u' name='unread'/>"
+"	  <arg type='u' name='new'/>"
+"	  <arg type='u' name='n_folders_new'/>"
+"	</signal>"
+"  </interface>"
+"</node>";
+
+static GDBusConnection *bus = NULL;
+static guint registration_id = 0;
+
+static guint coalesce_id = 0;
+static ucount_totals_t last_emitted;
+
+static gint64 bg_rss_saved_kib = -1;
+static gint64 bg_rebuild_latency_us = -1;
+
+// -----------------------------
+
+static GVariant *get_counts(guint offset, guint limit) {
+	GVariantBuilder folders;
+	ucount_totals_t totals;
+	
+	ucount_get_totals(&totals);
+	
+	if(limit == 0 || limit > MAX_PAGE_SIZE)
+		limit = MAX_PAGE_SIZE;
+	
+	g_variant_builder_init(&folders, G_VARIANT_TYPE("a(suu)"));
+	
+	for(guint i = offset; i - offset < limit; i++) {
+		const gchar *folder;
+		guint count, checkpoint;
+		
+		if(!ucount_get_folder(i, &folder, &count, &checkpoint))
+			break;
+		
+		g_variant_builder_add(&folders, "(suu)", folder, count, checkpoint);
+	}
+	
+	return g_variant_new("(uuuua(suu))", totals.unread, totals.new,
+		totals.n_folders_new, totals.n_folders, &folders);
+}
+
+static GVariant *dump_trace(void) {
+	// Room for the whole ring
+	static trace_record_t records[TRACE_SIZE];
+	GVariantBuilder builder;
+	
+	guint n = trace_snapshot(records, G_N_ELEMENTS(records));
+	
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a(xssiii)"));
+	
+	for(guint i = 0; i < n; i++) {
+		g_variant_builder_add(&builder, "(xssiii)", records[i].time,
+			trace_type_name(records[i].type), records[i].what ? records[i].what : "",
+			records[i].a, records[i].b, records[i].c);
+	}
+	
+	return g_variant_new("(a(xssiii))", &builder);
+}
+
+static void on_method_call(GDBusConnection *conn, const gchar *sender,
+	const gchar *object_path, const gchar *iface, const gchar *method_name,
+	GVariant *params, GDBusMethodInvocation *inv, gpointer user_data)
+{
+	TRACE_BEGIN();
+	
+	if(g_strcmp0(method_name, "GetCounts") == 0) {
+		guint offset, limit;
+		g_variant_get(params, "(uu)", &offset, &limit);
+		
+		g_dbus_method_invocation_return_value(inv, get_counts(offset, limit));
+		TRACE_END("api-get-counts");
+	} else if(g_strcmp0(method_name, "DumpTrace") == 0)
+		g_dbus_method_invocation_return_value(inv, dump_trace());
+	else if(g_strcmp0(method_name, "GetBackgroundStats") == 0) {
+		g_dbus_method_invocation_return_value(inv, g_variant_new("(xx)",
+			bg_rss_saved_kib, bg_rebuild_latency_us));
+	}
+}
+
+static gboolean on_coalesce_timeout(gpointer user_data) {
+	ucount_totals_t totals;
+	
+	coalesce_id = 0;
+	
+	ucount_get_totals(&totals);
+	
+	if(totals.unread == last_emitted.unread
+		&& totals.new == last_emitted.new
+		&& totals.n_folders_new == last_emitted.n_folders_new)
+	{
+		return G_SOURCE_REMOVE;
+	}
+	
+	last_emitted = totals;
+	
+	trace_record(TRACE_DBUS, "counts-changed", totals.unread,
+		totals.new, totals.n_folders_new);
+	
+	g_dbus_connection_emit_signal(bus, NULL, API_OBJECT_PATH,
+		API_INTERFACE, "CountsChanged", g_variant_new("(uuu)",
+		totals.unread, totals.new, totals.n_folders_new), NULL);
+	
+	return G_SOURCE_REMOVE;
+}
+
+// -----------------------------
+
+/* Note that the ucount state might have changed. Cheap enough to call
+ * after every event, the signal is only emitted after COALESCE_MS. */
+void api_counts_changed(void) {
+	if(registration_id == 0 || coalesce_id)
+		return;
+	
+	coalesce_id = g_timeout_add(COALESCE_MS, on_coalesce_timeout, NULL);
+}
+
+// Negative values leave the respective stat as it was
+void api_set_background_stats(gint64 rss_saved_kib, gint64 rebuild_latency_us) {
+	if(rss_saved_kib >= 0)
+		bg_rss_saved_kib = rss_saved_kib;
+	
+	if(rebuild_latency_us >= 0)
+		bg_rebuild_latency_us = rebuild_latency_us;
+}
+
+gint api_init(GDBusConnection *connection) {
+	GDBusNodeInfo *introspection_data = NULL;
+	GError *error = NULL;
+	
+	gint return_code = -1;
+	
+	bus = g_object_ref(connection);
+	ucount_get_totals(&last_emitted);
+	
+	introspection_data = g_dbus_node_info_new_for_xml(introspection_xml, &error);
+	
+	if(!introspection_data) {
+		g_printerr("Evolution Tray: dbus: "
+			"Failed to parse API introspection xml data: %s\n", error->message);
+		goto end;
+	}
+	
+	static const GDBusInterfaceVTable interface_vtable = {
+		.method_call = on_method_call
+	};
+	
+	registration_id = g_dbus_connection_register_object(bus,
+		API_OBJECT_PATH, introspection_data->interfaces[0],
+		&interface_vtable, NULL, NULL, &error);
+	
+	trace_record(TRACE_DBUS, "api-register-object", (registration_id != 0), 0, 0);
+	
+	if(registration_id == 0) {
+		g_printerr("Evolution Tray: dbus: "
+			"Failed to register API object: %s\n", error->message);
+		goto end;
+	}
+	
+	return_code = 0;
+	
+end:
+	
+	g_clear_pointer(&introspection_data, g_dbus_node_info_unref);
+	g_clear_error(&error);
+	
+	if(return_code != 0)
+		api_fini();
+	
+	return return_code;
+}
+
+void api_fini(void) {
+	g_clear_handle_id(&coalesce_id, g_source_remove);
+	
+	if(registration_id > 0) {
+		g_dbus_connection_unregister_object(bus, registration_id);
+		registration_id = 0;
+	}
+	
+	g_clear_object(&bus);
+}
@@ -0,0 +1,13 @@
+#ifndef EVOLUTION_TRAY_API_H
+#define EVOLUTION_TRAY_API_H
+
+#define API_INTERFACE "org.gnome.evolution.plugin.EvolutionTray"
+#define API_OBJECT_PATH "/EvolutionTray"
+
+gint api_init(GDBusConnection *connection);
+void api_fini(void);
+
+void api_counts_changed(void);
+void api_set_background_stats(gint64 rss_saved_kib, gint64 rebuild_latency_us);
+
+#endif /* EVOLUTION_TRAY_API_H */
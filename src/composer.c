@@ -0,0 +1,190 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* A pre-built composer, for the "New Message" tray action.
+ *
+ * Creating a composer is slow, mostly because of the editor's web view.
+ * To have one ready the moment the user asks for it, we build one in the
+ * background, while idle, and keep it around unshown. When the user wants
+ * to write a message, we show the spare one and prepare the next.
+ *
+ * A spare composer is not free, memory-wise. It's released (together with
+ * the rest that we can spare) once the main window has been hidden for a
+ * while, and built again when the main window comes back. A request while
+ * no spare composer exists just gets one created on demand.
+ *
+ * The spare is a window of the application, which the application must not
+ * count as open until it's shown. Otherwise, closing the main window would
+ * not quit evolution, with only the (invisible) spare keeping it alive. So
+ * it's kept out of the application's windows until presented. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include <glib.h>
+#include <glib/gprintf.h>
+
+#include <shell/e-shell.h>
+#include <composer/e-msg-composer.h>
+
+#include "composer.h"
+
+// Let evolution's own startup settle before warming up
+#define WARM_DELAY_SECONDS 5
+
+// The spare composer, not yet shown to the user
+static EMsgComposer *spare = NULL;
+
+static guint warm_source_id = 0;
+
+/* A composer is under construction. If open_pending, show it
+ * to the user when done, instead of keeping it as the spare. */
+static gboolean creating = FALSE;
+static gboolean open_pending = FALSE;
+
+/* Bumped on fini, so that a creation still in
+ * progress knows to discard its result. */
+static guint generation = 0;
+
+// -----------------------------
+
+static void present(EMsgComposer *composer) {
+	EShell *shell = e_shell_get_default();
+	
+	// A no-op, unless it was the spare
+	if(shell)
+		gtk_application_add_window(GTK_APPLICATION(shell), GTK_WINDOW(composer));
+	
+	gtk_widget_show(GTK_WIDGET(composer));
+	gtk_window_present(GTK_WINDOW(composer));
+}
+
+static void on_composer_created(GObject *source,
+	GAsyncResult *result, gpointer user_data)
+{
+	guint gen = GPOINTER_TO_UINT(user_data);
+	GError *error = NULL;
+	
+	EMsgComposer *composer = e_msg_composer_new_finish(result, &error);
+	
+	if(!composer) {
+		g_printerr("Evolution Tray: Failed to create composer: %s\n",
+			error ? error->message : "unknown error");
+		g_clear_error(&error);
+	}
+	
+	if(gen != generation) {
+		if(composer)
+			gtk_widget_destroy(GTK_WIDGET(composer));
+		return;
+	}
+	
+	creating = FALSE;
+	
+	if(!composer) {
+		open_pending = FALSE;
+		return;
+	}
+	
+	if(open_pending) {
+		open_pending = FALSE;
+		present(composer);
+		return;
+	}
+	
+	gtk_application_remove_window(GTK_APPLICATION(e_shell_get_default()),
+		GTK_WINDOW(composer));
+	
+	spare = composer;
+	g_object_add_weak_pointer(G_OBJECT(spare), (gpointer *) &spare);
+}
+
+static void create(void) {
+	EShell *shell = e_shell_get_default();
+	if(!shell || creating) return;
+	
+	creating = TRUE;
+	
+	e_msg_composer_new(shell, on_composer_created,
+		GUINT_TO_POINTER(generation));
+}
+
+static gboolean on_warm(gpointer user_data) {
+	warm_source_id = 0;
+	
+	if(!spare)
+		create();
+	
+	return G_SOURCE_REMOVE;
+}
+
+// -----------------------------
+
+/* Build the spare composer, at low priority, once things are quiet. */
+void composer_warm(void) {
+	if(spare || creating || warm_source_id)
+		return;
+	
+	warm_source_id = g_timeout_add_seconds_full(G_PRIORITY_LOW,
+		WARM_DELAY_SECONDS, on_warm, NULL, NULL);
+}
+
+void composer_release(void) {
+	g_clear_handle_id(&warm_source_id, g_source_remove);
+	
+	if(spare) {
+		EMsgComposer *composer = spare;
+		g_object_remove_weak_pointer(G_OBJECT(spare), (gpointer *) &spare);
+		spare = NULL;
+		
+		gtk_widget_destroy(GTK_WIDGET(composer));
+	}
+}
+
+void composer_open(void) {
+	if(spare) {
+		EMsgComposer *composer = spare;
+		g_object_remove_weak_pointer(G_OBJECT(spare), (gpointer *) &spare);
+		spare = NULL;
+		
+		present(composer);
+		
+		// Have the next one ready
+		composer_warm();
+		
+		return;
+	}
+	
+	// No spare one? Build one now, and show it when it's done
+	open_pending = TRUE;
+	create();
+}
+
+void composer_init(void) {
+	composer_warm();
+}
+
+void composer_fini(void) {
+	composer_release();
+	
+	generation++;
+	creating = FALSE;
+	open_pending = FALSE;
+}
@@ -0,0 +1,11 @@
+#ifndef EVOLUTION_TRAY_COMPOSER_H
+#define EVOLUTION_TRAY_COMPOSER_H
+
+void composer_init(void);
+void composer_fini(void);
+
+void composer_open(void);
+void composer_warm(void);
+void composer_release(void);
+
+#endif /* EVOLUTION_TRAY_COMPOSER_H */
@@ -0,0 +1,127 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Writer side of the counter page (see counters/etray-counters.h), for
+ * readers that poll too often for even a D-Bus call to be reasonable.
+ * We're the only writer, so updating is just a few stores and fences. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gprintf.h>
+
+#include "etray-counters.h"
+#include "counterpage.h"
+
+// Leave room for appending fields, without changing the file size
+#define PAGE_FILE_SIZE 4096
+
+static etray_counters_page *page = NULL;
+static gchar *page_path = NULL;
+
+gint counterpage_init(void) {
+	page_path = g_build_filename(g_get_user_runtime_dir(),
+		ETRAY_COUNTERS_FILENAME, NULL);
+	
+	/* Don't reuse an existing file, a reader might still have it mapped
+	 * (e.g. from a previous session). It will see the cleared magic, and
+	 * will know to reopen. */
+	unlink(page_path);
+	
+	int fd = open(page_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	
+	if(fd == -1) {
+		g_printerr("Evolution Tray: Failed to create counter page '%s': %s\n",
+			page_path, g_strerror(errno));
+		g_clear_pointer(&page_path, g_free);
+		return -1;
+	}
+	
+	void *map = MAP_FAILED;
+	
+	if(ftruncate(fd, PAGE_FILE_SIZE) == 0) {
+		map = mmap(NULL, PAGE_FILE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	}
+	
+	close(fd);
+	
+	if(map == MAP_FAILED) {
+		g_printerr("Evolution Tray: Failed to map counter page '%s': %s\n",
+			page_path, g_strerror(errno));
+		unlink(page_path);
+		g_clear_pointer(&page_path, g_free);
+		return -2;
+	}
+	
+	page = map;
+	page->version = ETRAY_COUNTERS_VERSION;
+	page->updated_us = g_get_monotonic_time();
+	
+	// Publish last, readers check the magic first
+	__atomic_store_n(&page->magic, ETRAY_COUNTERS_MAGIC, __ATOMIC_RELEASE);
+	
+	return 0;
+}
+
+void counterpage_fini(void) {
+	if(page) {
+		__atomic_store_n(&page->magic, 0, __ATOMIC_RELEASE);
+		munmap(page, PAGE_FILE_SIZE);
+		page = NULL;
+	}
+	
+	if(page_path) {
+		unlink(page_path);
+		g_clear_pointer(&page_path, g_free);
+	}
+}
+
+void counterpage_update(guint unread, guint new_count, gboolean status_unread) {
+	if(!page) return;
+	
+	guint32 status = (status_unread ? ETRAY_STATUS_UNREAD : ETRAY_STATUS_READ);
+	
+	// Nothing to tell, don't wake up the readers that watch seq
+	if(__atomic_load_n(&page->unread, __ATOMIC_RELAXED) == unread
+		&& __atomic_load_n(&page->new_count, __ATOMIC_RELAXED) == new_count
+		&& __atomic_load_n(&page->status, __ATOMIC_RELAXED) == status)
+	{
+		return;
+	}
+	
+	guint32 seq = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+	
+	__atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	
+	__atomic_store_n(&page->unread, unread, __ATOMIC_RELAXED);
+	__atomic_store_n(&page->new_count, new_count, __ATOMIC_RELAXED);
+	__atomic_store_n(&page->status, status, __ATOMIC_RELAXED);
+	__atomic_store_n(&page->updated_us, g_get_monotonic_time(), __ATOMIC_RELAXED);
+	
+	__atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,9 @@
+#ifndef EVOLUTION_TRAY_COUNTERPAGE_H
+#define EVOLUTION_TRAY_COUNTERPAGE_H
+
+gint counterpage_init(void);
+void counterpage_fini(void);
+
+void counterpage_update(guint unread, guint new_count, gboolean status_unread);
+
+#endif /* EVOLUTION_TRAY_COUNTERPAGE_H */
@@ -0,0 +1,345 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Per-account tray icons, next to the main one. Opt-in, see the
+ * account-icons and account-icon-groups keys.
+ *
+ * Accounts are gathered into groups, each with its own item (see sn.c).
+ * Every entry of account-icon-groups is a comma-separated list of account
+ * names, which share a single item. Any other account gets one of its own.
+ * A group's item shows new mail when any of its accounts has a folder over
+ * its checkpoint, as per ucount's per-account aggregates.
+ *
+ * Work is proportional to the items that (may) change, not to their total
+ * number. An unread event only concerns the group of the folder's account,
+ * which is found through a hash table. A checkpoint can only turn items to
+ * read, so only the groups currently showing new mail are looked at, which
+ * are kept in a set of their own. Icons are only re-sent when they change.
+ *
+ * Accounts added later get their group the first time they're heard of. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gio/gio.h>
+#include <glib/gprintf.h>
+
+#include "items.h"
+#include "accounts.h"
+#include "ucount.h"
+#include "properties.h"
+
+typedef struct items_group_t {
+	// The account names from account-icon-groups, if any
+	gchar **names;
+	
+	// Accounts, as they appear in folder URIs
+	GPtrArray *accounts;
+	
+	sn_item_t *item;
+	gboolean lit;
+} items_group_t;
+
+static GSettings *settings = NULL;
+static gboolean active = FALSE;
+
+static sn_callbacks_t item_callbacks;
+static const gchar *icon_read = NULL;
+static const gchar *icon_unread = NULL;
+
+static GPtrArray *groups = NULL;
+
+// Account -> items_group_t (NULL for accounts without an item)
+static GHashTable *account_groups = NULL;
+
+// The groups with new mail
+static GHashTable *lit_groups = NULL;
+
+// -----------------------------
+
+static void group_free(gpointer data) {
+	items_group_t *group = data;
+	
+	sn_item_free(group->item);
+	g_ptr_array_unref(group->accounts);
+	g_strfreev(group->names);
+	g_free(group);
+}
+
+static items_group_t *group_new(gchar **names) {
+	items_group_t *group = g_new0(items_group_t, 1);
+	
+	group->names = names;
+	group->accounts = g_ptr_array_new_with_free_func(g_free);
+	
+	g_ptr_array_add(groups, group);
+	
+	return group;
+}
+
+static items_group_t *find_named_group(const gchar *name) {
+	for(guint i = 0; i < groups->len; i++) {
+		items_group_t *group = g_ptr_array_index(groups, i);
+		
+		if(group->names && g_strv_contains((const gchar * const *) group->names, name))
+			return group;
+	}
+	
+	return NULL;
+}
+
+static void update_group(items_group_t *group) {
+	gboolean lit = FALSE;
+	
+	for(guint i = 0; i < group->accounts->len && !lit; i++) {
+		ucount_totals_t totals;
+		
+		if(ucount_get_account_totals(g_ptr_array_index(group->accounts, i), &totals))
+			lit = (totals.n_folders_new > 0);
+	}
+	
+	if(lit == group->lit)
+		return;
+	
+	group->lit = lit;
+	
+	if(lit)
+		g_hash_table_add(lit_groups, group);
+	else
+		g_hash_table_remove(lit_groups, group);
+	
+	if(group->item)
+		sn_item_set_icon(group->item, lit ? icon_unread : icon_read);
+}
+
+/* Put the account in its group, if it's one we want an item for. The
+ * store's display name decides the group, and becomes its item's title. */
+static items_group_t *add_account(const gchar *account) {
+	EMailSession *session = accounts_get_session();
+	if(!session) return NULL;
+	
+	gchar *uid = g_strdup(account);
+	camel_url_decode(uid);
+	
+	CamelService *service = camel_session_ref_service(CAMEL_SESSION(session), uid);
+	items_group_t *group = NULL;
+	
+	if(service && CAMEL_IS_STORE(service)
+		&& g_strcmp0(uid, E_MAIL_SESSION_VFOLDER_UID) != 0)
+	{
+		const gchar *name = camel_service_get_display_name(service);
+		
+		group = find_named_group(name);
+		if(!group) group = group_new(NULL);
+		
+		g_ptr_array_add(group->accounts, g_strdup(account));
+		
+		if(!group->item) {
+			gchar *title = (group->names ? g_strjoinv(", ", group->names) : g_strdup(name));
+			
+			group->item = sn_item_new(title, title, icon_read, &item_callbacks, group);
+			g_free(title);
+		}
+	}
+	
+	g_hash_table_insert(account_groups, g_strdup(account), group);
+	
+	g_clear_object(&service);
+	g_free(uid);
+	
+	return group;
+}
+
+static items_group_t *group_for_account(const gchar *account) {
+	gpointer group;
+	
+	if(g_hash_table_lookup_extended(account_groups, account, NULL, &group))
+		return group;
+	
+	return add_account(account);
+}
+
+static void start(void) {
+	groups = g_ptr_array_new_with_free_func(group_free);
+	account_groups = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	lit_groups = g_hash_table_new(NULL, NULL);
+	
+	gchar **specs = g_settings_get_strv(settings, CONF_KEY_ACCOUNT_ICON_GROUPS);
+	
+	for(gchar **spec = specs; *spec != NULL; spec++) {
+		gchar **names = g_strsplit(*spec, ",", -1);
+		
+		for(gchar **name = names; *name != NULL; name++)
+			g_strstrip(*name);
+		
+		group_new(names);
+	}
+	
+	g_strfreev(specs);
+	
+	GList *stores = accounts_ref_stores();
+	
+	for(GList *l = stores; l != NULL; l = g_list_next(l)) {
+		gchar *account = accounts_folder_uri_account(
+			camel_service_get_uid(CAMEL_SERVICE(l->data)));
+		
+		items_group_t *group = group_for_account(account);
+		if(group) update_group(group);
+		
+		g_free(account);
+	}
+	
+	g_list_free_full(stores, g_object_unref);
+	
+	active = TRUE;
+}
+
+static void stop(void) {
+	g_clear_pointer(&lit_groups, g_hash_table_destroy);
+	g_clear_pointer(&account_groups, g_hash_table_destroy);
+	g_clear_pointer(&groups, g_ptr_array_unref);
+	
+	active = FALSE;
+}
+
+static void on_settings_changed(GSettings *s, const gchar *key, gpointer user_data) {
+	if(!g_str_equal(key, CONF_KEY_ACCOUNT_ICONS)
+		&& !g_str_equal(key, CONF_KEY_ACCOUNT_ICON_GROUPS))
+	{
+		return;
+	}
+	
+	if(active)
+		stop();
+	
+	if(g_settings_get_boolean(settings, CONF_KEY_ACCOUNT_ICONS))
+		start();
+}
+
+// -----------------------------
+
+// The unread count of the folder changed
+void items_folder_changed(const gchar *folder) {
+	if(!active)
+		return;
+	
+	gchar *account = ucount_folder_account(folder);
+	items_group_t *group = group_for_account(account);
+	
+	if(group)
+		update_group(group);
+	
+	g_free(account);
+}
+
+void items_account_removed(const gchar *account) {
+	if(!active)
+		return;
+	
+	items_group_t *group = g_hash_table_lookup(account_groups, account);
+	g_hash_table_remove(account_groups, account);
+	
+	if(!group)
+		return;
+	
+	for(guint i = 0; i < group->accounts->len; i++) {
+		if(g_str_equal(g_ptr_array_index(group->accounts, i), account)) {
+			g_ptr_array_remove_index(group->accounts, i);
+			break;
+		}
+	}
+	
+	// Named groups stay around, for if their accounts come back
+	if(group->accounts->len == 0) {
+		g_clear_pointer(&group->item, sn_item_free);
+		g_hash_table_remove(lit_groups, group);
+		group->lit = FALSE;
+	} else
+		update_group(group);
+}
+
+/* A checkpoint was set, or reached. Only
+ * the groups with new mail can be affected. */
+void items_checkpoint(void) {
+	if(!active || g_hash_table_size(lit_groups) == 0)
+		return;
+	
+	guint n;
+	gpointer *lit = g_hash_table_get_keys_as_array(lit_groups, &n);
+	
+	for(guint i = 0; i < n; i++)
+		update_group(lit[i]);
+	
+	g_free(lit);
+}
+
+// Anything might have changed (e.g. after seeding), look at all groups
+void items_refresh(void) {
+	if(!active)
+		return;
+	
+	for(guint i = 0; i < groups->len; i++)
+		update_group(g_ptr_array_index(groups, i));
+}
+
+gboolean items_group_has_account(const items_group_t *group, const gchar *account) {
+	for(guint i = 0; i < group->accounts->len; i++) {
+		if(g_str_equal(g_ptr_array_index(group->accounts, i), account))
+			return TRUE;
+	}
+	
+	return FALSE;
+}
+
+// Acknowledge the new mail of the group's accounts only
+void items_group_set_checkpoint(items_group_t *group) {
+	for(guint i = 0; i < group->accounts->len; i++)
+		ucount_account_set_checkpoint(g_ptr_array_index(group->accounts, i));
+	
+	update_group(group);
+}
+
+gint items_init(const sn_callbacks_t *callbacks,
+	const gchar *read, const gchar *unread)
+{
+	settings = g_settings_new(TRAY_SCHEMA);
+	if(!settings) return -1;
+	
+	item_callbacks = *callbacks;
+	icon_read = read;
+	icon_unread = unread;
+	
+	g_signal_connect(settings, "changed",
+		G_CALLBACK(on_settings_changed), NULL);
+	
+	if(g_settings_get_boolean(settings, CONF_KEY_ACCOUNT_ICONS))
+		start();
+	
+	return 0;
+}
+
+void items_fini(void) {
+	if(active)
+		stop();
+	
+	if(settings) {
+		g_signal_handlers_disconnect_by_func(settings, on_settings_changed, NULL);
+		g_clear_object(&settings);
+	}
+}
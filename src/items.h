@@ -0,0 +1,20 @@
+#ifndef EVOLUTION_TRAY_ITEMS_H
+#define EVOLUTION_TRAY_ITEMS_H
+
+#include "sn.h"
+
+typedef struct items_group_t items_group_t;
+
+gint items_init(const sn_callbacks_t *callbacks,
+	const gchar *icon_read, const gchar *icon_unread);
+void items_fini(void);
+
+void items_folder_changed(const gchar *folder);
+void items_account_removed(const gchar *account);
+void items_checkpoint(void);
+void items_refresh(void);
+
+gboolean items_group_has_account(const items_group_t *group, const gchar *account);
+void items_group_set_checkpoint(items_group_t *group);
+
+#endif /* EVOLUTION_TRAY_ITEMS_H */
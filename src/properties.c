@@ -79,6 +79,38 @@ toggle_hidden_on_close_cb(GtkWidget *widget, gpointer data)
 			gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)));
 }
 
+static void
+toggled_background_mode_cb(GtkWidget *widget, gpointer data)
+{
+	g_return_if_fail(widget != NULL);
+	set_part_enabled(TRAY_SCHEMA, CONF_KEY_BACKGROUND_MODE,
+			gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)));
+}
+
+static void
+toggled_adaptive_refresh_cb(GtkWidget *widget, gpointer data)
+{
+	g_return_if_fail(widget != NULL);
+	set_part_enabled(TRAY_SCHEMA, CONF_KEY_ADAPTIVE_REFRESH,
+			gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)));
+}
+
+static void
+toggled_account_icons_cb(GtkWidget *widget, gpointer data)
+{
+	g_return_if_fail(widget != NULL);
+	set_part_enabled(TRAY_SCHEMA, CONF_KEY_ACCOUNT_ICONS,
+			gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)));
+}
+
+static void
+toggled_calendar_reminders_cb(GtkWidget *widget, gpointer data)
+{
+	g_return_if_fail(widget != NULL);
+	set_part_enabled(TRAY_SCHEMA, CONF_KEY_CALENDAR_REMINDERS,
+			gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(widget)));
+}
+
 /******************************************************************************
  * Properties widget
  *****************************************************************************/
@@ -115,6 +147,42 @@ get_cfg_widget()
 	gtk_widget_show(check);
 	gtk_box_pack_start(GTK_BOX(container), check, FALSE, FALSE, 0);
 
+	check = gtk_check_button_new_with_mnemonic(_("Free memory while hidden"));
+	gtk_widget_set_tooltip_text(check, _("Release the main window when it "
+			"stays hidden for a while, and rebuild it when it's needed again"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check),
+			is_part_enabled(TRAY_SCHEMA, CONF_KEY_BACKGROUND_MODE));
+	g_signal_connect(G_OBJECT(check), "toggled",
+			G_CALLBACK(toggled_background_mode_cb), NULL);
+	gtk_widget_show(check);
+	gtk_box_pack_start(GTK_BOX(container), check, FALSE, FALSE, 0);
+
+	check = gtk_check_button_new_with_mnemonic(_("Check for new mail as often as it arrives"));
+	gtk_widget_set_tooltip_text(check, _("For accounts without push (IMAP IDLE) "
+			"and without a periodic check for new messages of their own"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check),
+			is_part_enabled(TRAY_SCHEMA, CONF_KEY_ADAPTIVE_REFRESH));
+	g_signal_connect(G_OBJECT(check), "toggled",
+			G_CALLBACK(toggled_adaptive_refresh_cb), NULL);
+	gtk_widget_show(check);
+	gtk_box_pack_start(GTK_BOX(container), check, FALSE, FALSE, 0);
+
+	check = gtk_check_button_new_with_mnemonic(_("Show an icon per account"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check),
+			is_part_enabled(TRAY_SCHEMA, CONF_KEY_ACCOUNT_ICONS));
+	g_signal_connect(G_OBJECT(check), "toggled",
+			G_CALLBACK(toggled_account_icons_cb), NULL);
+	gtk_widget_show(check);
+	gtk_box_pack_start(GTK_BOX(container), check, FALSE, FALSE, 0);
+
+	check = gtk_check_button_new_with_mnemonic(_("Show calendar and task reminders"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check),
+			is_part_enabled(TRAY_SCHEMA, CONF_KEY_CALENDAR_REMINDERS));
+	g_signal_connect(G_OBJECT(check), "toggled",
+			G_CALLBACK(toggled_calendar_reminders_cb), NULL);
+	gtk_widget_show(check);
+	gtk_box_pack_start(GTK_BOX(container), check, FALSE, FALSE, 0);
+
 	return container;
 }
 
@@ -7,6 +7,13 @@
 #define CONF_KEY_HIDDEN_ON_STARTUP		"hidden-on-startup"
 #define CONF_KEY_HIDE_ON_MINIMIZE		"hide-on-minimize"
 #define CONF_KEY_HIDE_ON_CLOSE			"hide-on-close"
+#define CONF_KEY_BACKGROUND_MODE		"background-mode"
+#define CONF_KEY_ADAPTIVE_REFRESH		"adaptive-refresh"
+#define CONF_KEY_REFRESH_MIN_INTERVAL	"refresh-min-interval"
+#define CONF_KEY_REFRESH_MAX_INTERVAL	"refresh-max-interval"
+#define CONF_KEY_ACCOUNT_ICONS			"account-icons"
+#define CONF_KEY_ACCOUNT_ICON_GROUPS	"account-icon-groups"
+#define CONF_KEY_CALENDAR_REMINDERS		"calendar-reminders"
 
 gboolean is_part_enabled(gchar *schema, const gchar *key);
 void properties_show(void);
@@ -0,0 +1,289 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Adaptive refresh: checks the accounts that need polling for new mail,
+ * at intervals that follow how often mail actually arrives in each one,
+ * instead of a fixed one for all. Opt-in, see the adaptive-refresh key.
+ *
+ * The accounts that need polling are those without IMAP IDLE, and without
+ * Evolution's own periodic check (see accounts_store_is_polled()); turning
+ * the latter off for an account hands it over to us. The new mails that
+ * ucount sees feed the per-account arrival rates, and sched.c turns them
+ * into refresh times, between the configured bounds. While the window has
+ * been hidden for a while (see tray.c), intervals are stretched further.
+ *
+ * A single timeout is armed at a time, for the earliest refresh due. Every
+ * time it fires, the polled accounts are also looked up anew, which picks
+ * up any added accounts, or changed account settings. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gio/gio.h>
+#include <glib/gprintf.h>
+
+#include "refresh.h"
+#include "sched.h"
+#include "accounts.h"
+#include "ucount.h"
+#include "properties.h"
+#include "trace.h"
+
+// Half-life of the arrival rates
+#define HALF_LIFE_SECONDS (2 * 3600)
+
+// Refresh intervals are this many times longer while idle
+#define IDLE_FACTOR 4
+
+// Don't let a misconfiguration hammer the servers
+#define MIN_INTERVAL_FLOOR 30
+
+static GSettings *settings = NULL;
+static sched_params_t params;
+
+static gboolean active = FALSE;
+static gboolean idle = FALSE;
+
+// Account (as it appears in folder URIs) -> store UID
+static GHashTable *uids = NULL;
+
+static guint timeout_id = 0;
+
+// -----------------------------
+
+static void read_params(void) {
+	params.min_interval = MAX(g_settings_get_uint(settings,
+		CONF_KEY_REFRESH_MIN_INTERVAL), MIN_INTERVAL_FLOOR);
+	params.max_interval = g_settings_get_uint(settings,
+		CONF_KEY_REFRESH_MAX_INTERVAL);
+	params.half_life = HALF_LIFE_SECONDS;
+	params.idle_factor = IDLE_FACTOR;
+}
+
+/* Bring the scheduled accounts in line with
+ * the accounts that currently need polling. */
+static void sync_accounts(gint64 now) {
+	GHashTable *polled = g_hash_table_new_full(g_str_hash,
+		g_str_equal, g_free, g_free);
+	GList *stores = accounts_ref_stores();
+	
+	for(GList *l = stores; l != NULL; l = g_list_next(l)) {
+		CamelStore *store = CAMEL_STORE(l->data);
+		
+		if(!accounts_store_is_polled(store))
+			continue;
+		
+		const gchar *uid = camel_service_get_uid(CAMEL_SERVICE(store));
+		gchar *account = accounts_folder_uri_account(uid);
+		
+		if(sched_add_account(account, now))
+			trace_record(TRACE_REFRESH, "add", 0, 0, 0);
+		
+		g_hash_table_insert(polled, account, g_strdup(uid));
+	}
+	
+	g_list_free_full(stores, g_object_unref);
+	
+	if(uids) {
+		GHashTableIter iter;
+		const gchar *account;
+		
+		g_hash_table_iter_init(&iter, uids);
+		
+		while(g_hash_table_iter_next(&iter, (gpointer *) &account, NULL)) {
+			if(!g_hash_table_contains(polled, account)) {
+				sched_remove_account(account);
+				trace_record(TRACE_REFRESH, "remove", 0, 0, 0);
+			}
+		}
+		
+		g_hash_table_destroy(uids);
+	}
+	
+	uids = polled;
+}
+
+static gboolean on_timeout(gpointer user_data);
+
+static void arm(gint64 now) {
+	g_clear_handle_id(&timeout_id, g_source_remove);
+	
+	/* With nothing to poll, still come back now and
+	 * then, in case there's something new to poll. */
+	gint64 due = sched_next_due();
+	if(due < 0) due = now + (gint64) params.max_interval * G_USEC_PER_SEC;
+	
+	guint delay = (due > now ? (guint) ((due - now + G_USEC_PER_SEC - 1)
+		/ G_USEC_PER_SEC) : 0);
+	
+	// When it's meant to fire, and whether the scheduler had a say in it
+	trace_record(TRACE_REFRESH, "arm", (gint) delay, sched_next_due() >= 0, 0);
+	
+	timeout_id = g_timeout_add_seconds(delay, on_timeout, NULL);
+}
+
+static gboolean on_timeout(gpointer user_data) {
+	timeout_id = 0;
+	
+	gint64 now = g_get_monotonic_time();
+	const gchar *account;
+	
+	sync_accounts(now);
+	
+	while((account = sched_pop_due(now)) != NULL) {
+		trace_record(TRACE_REFRESH, "refresh",
+			(gint) sched_get_interval(account, now),
+			(gint) (sched_get_rate(account, now) * 1000), idle);
+		
+		accounts_receive(g_hash_table_lookup(uids, account));
+	}
+	
+	arm(now);
+	
+	return G_SOURCE_REMOVE;
+}
+
+static void start(void) {
+	gint64 now = g_get_monotonic_time();
+	
+	read_params();
+	
+	if(sched_init(&params) != 0) {
+		g_printerr("Evolution Tray: Refresh scheduler init failed\n");
+		return;
+	}
+	
+	sched_set_idle(idle, now);
+	sync_accounts(now);
+	arm(now);
+	
+	active = TRUE;
+}
+
+static void stop(void) {
+	g_clear_handle_id(&timeout_id, g_source_remove);
+	g_clear_pointer(&uids, g_hash_table_destroy);
+	sched_fini();
+	
+	active = FALSE;
+}
+
+static void on_settings_changed(GSettings *s, const gchar *key, gpointer user_data) {
+	if(!g_str_equal(key, CONF_KEY_ADAPTIVE_REFRESH)
+		&& !g_str_equal(key, CONF_KEY_REFRESH_MIN_INTERVAL)
+		&& !g_str_equal(key, CONF_KEY_REFRESH_MAX_INTERVAL))
+	{
+		return;
+	}
+	
+	gboolean enabled = g_settings_get_boolean(settings, CONF_KEY_ADAPTIVE_REFRESH);
+	
+	if(enabled && !active)
+		start();
+	else if(!enabled && active)
+		stop();
+	else if(active) {
+		gint64 now = g_get_monotonic_time();
+		
+		read_params();
+		sched_set_params(&params, now);
+		arm(now);
+	}
+}
+
+// -----------------------------
+
+// N new mails arrived in the folder
+void refresh_arrival(const gchar *folder, guint n) {
+	if(!active || n == 0)
+		return;
+	
+	gint64 now = g_get_monotonic_time();
+	gchar *account = ucount_folder_account(folder);
+	
+	if(sched_has_account(account)) {
+		sched_arrival(account, n, now);
+		arm(now);
+	}
+	
+	g_free(account);
+}
+
+void refresh_account_removed(const gchar *account) {
+	if(!active)
+		return;
+	
+	sched_remove_account(account);
+	g_hash_table_remove(uids, account);
+	
+	arm(g_get_monotonic_time());
+}
+
+// All accounts were just checked for new mail (i.e. Send/Receive)
+void refresh_all_refreshed(void) {
+	if(!active)
+		return;
+	
+	GHashTableIter iter;
+	const gchar *account;
+	gint64 now = g_get_monotonic_time();
+	
+	g_hash_table_iter_init(&iter, uids);
+	
+	while(g_hash_table_iter_next(&iter, (gpointer *) &account, NULL))
+		sched_refreshed(account, now);
+	
+	arm(now);
+}
+
+void refresh_set_idle(gboolean is_idle) {
+	idle = is_idle;
+	
+	if(active) {
+		gint64 now = g_get_monotonic_time();
+		
+		sched_set_idle(idle, now);
+		arm(now);
+	}
+}
+
+gint refresh_init(void) {
+	settings = g_settings_new(TRAY_SCHEMA);
+	if(!settings) return -1;
+	
+	g_signal_connect(settings, "changed",
+		G_CALLBACK(on_settings_changed), NULL);
+	
+	if(g_settings_get_boolean(settings, CONF_KEY_ADAPTIVE_REFRESH))
+		start();
+	
+	return 0;
+}
+
+void refresh_fini(void) {
+	if(active)
+		stop();
+	
+	if(settings) {
+		g_signal_handlers_disconnect_by_func(settings, on_settings_changed, NULL);
+		g_clear_object(&settings);
+	}
+	
+	idle = FALSE;
+}
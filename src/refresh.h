@@ -0,0 +1,12 @@
+#ifndef EVOLUTION_TRAY_REFRESH_H
+#define EVOLUTION_TRAY_REFRESH_H
+
+gint refresh_init(void);
+void refresh_fini(void);
+
+void refresh_arrival(const gchar *folder, guint n);
+void refresh_account_removed(const gchar *account);
+void refresh_all_refreshed(void);
+void refresh_set_idle(gboolean idle);
+
+#endif /* EVOLUTION_TRAY_REFRESH_H */
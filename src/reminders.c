@@ -0,0 +1,628 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Calendar and task reminders. Opt-in, see the calendar-reminders key.
+ *
+ * We connect to every enabled calendar and task list, and ask each one for
+ * its alarms over the next LOOKAHEAD_SECONDS (and, for task lists, also the
+ * tasks due in that time, alarm or not). Every alarm becomes a timer in the
+ * timer wheel (see wheel.c). When one fires, its reminder is moved to the
+ * pending list, and the tray is told (changed_cb), so that it may raise its
+ * attention state, and list the pending reminders in its menu. They stay
+ * pending until dismissed.
+ *
+ * Everything else that needs to happen at some point in time also goes
+ * through the wheel: re-querying all sources before the lookahead window
+ * runs out, and re-querying a single source shortly after it reports a
+ * change (which coalesces bursts of changes into one query). So, there's
+ * a single main loop timeout, armed for the earliest timer of the wheel,
+ * no matter how many reminders there are. Since the timeout runs on the
+ * monotonic clock, while reminders are on the wall clock (which can jump,
+ * e.g. across a suspend), the timeout is never armed for more than
+ * MAX_SLEEP_SECONDS.
+ *
+ * Each source also has a (UID-only) view open, for change notifications.
+ * Any change simply re-queries the source's alarms and replaces its timers,
+ * which is simpler than tracking changes per component, and cheap enough
+ * with the lookahead window bounding the number of alarm instances. The
+ * query starts from the last time the wheel was advanced, not from now: an
+ * alarm that came due while the query was running (or just before, with
+ * its timer not fired yet) is then added late, and fires right away. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gio/gio.h>
+#include <glib/gprintf.h>
+
+#include <libecal/libecal.h>
+#include <shell/e-shell.h>
+
+#include "reminders.h"
+#include "wheel.h"
+#include "properties.h"
+#include "trace.h"
+
+#define LOOKAHEAD_SECONDS (24 * 3600)
+#define RELOAD_SECONDS (12 * 3600)
+
+// Wait this long after a change in a source, before re-querying it
+#define REQUERY_DELAY_SECONDS 2
+
+#define MAX_SLEEP_SECONDS 600
+#define CONNECT_TIMEOUT_SECONDS 30
+
+typedef struct rsource_t {
+	ESource *source;
+	ECalClientSourceType type;
+	
+	ECalClient *client;
+	ECalClientView *view;
+	GCancellable *cancellable;
+	
+	// reminder_t, each with its timer in the wheel
+	GPtrArray *reminders;
+	wheel_timer_t *requery_timer;
+} rsource_t;
+
+typedef struct reminder_t {
+	rsource_t *rsource;
+	wheel_timer_t *timer;
+	
+	gchar *summary;
+	gint64 start;
+} reminder_t;
+
+static GSettings *settings = NULL;
+static gboolean active = FALSE;
+
+static ESourceRegistry *registry = NULL;
+
+// ESource UID -> rsource_t
+static GHashTable *rsources = NULL;
+
+// reminders_pending_t, oldest first
+static GPtrArray *pending = NULL;
+
+static wheel_timer_t *reload_timer = NULL;
+static guint timeout_id = 0;
+static gint64 armed_for = -1;
+
+// All timers up to this time have fired
+static gint64 fired_until = 0;
+
+static void (*global_changed_cb)(void) = NULL;
+
+static void rsource_query(rsource_t *rsource);
+
+static void notify_changed(void) {
+	if(global_changed_cb)
+		global_changed_cb();
+}
+
+// -----------------------------
+
+static gint64 now_seconds(void) {
+	return g_get_real_time() / G_USEC_PER_SEC;
+}
+
+static gboolean on_timeout(gpointer user_data);
+
+// Arm the main loop timeout for the earliest timer of the wheel
+static void arm(void) {
+	gint64 next = wheel_next_expiry();
+	
+	if(timeout_id && next == armed_for)
+		return;
+	
+	g_clear_handle_id(&timeout_id, g_source_remove);
+	armed_for = next;
+	
+	if(next < 0)
+		return;
+	
+	gint64 delay = CLAMP(next - now_seconds(), 0, MAX_SLEEP_SECONDS);
+	timeout_id = g_timeout_add_seconds((guint) delay, on_timeout, NULL);
+}
+
+static gboolean on_timeout(gpointer user_data) {
+	timeout_id = 0;
+	
+	gint64 now = now_seconds();
+	
+	guint n_fired = wheel_advance(now);
+	fired_until = now;
+	
+	trace_record(TRACE_REMINDER, "wakeup", n_fired, wheel_size(), 0);
+	
+	arm();
+	
+	return G_SOURCE_REMOVE;
+}
+
+// -----------------------------
+
+static void pending_free(gpointer data) {
+	reminders_pending_t *entry = data;
+	
+	g_free(entry->summary);
+	g_free(entry);
+}
+
+static void reminder_free(gpointer data) {
+	reminder_t *reminder = data;
+	
+	if(reminder->timer)
+		wheel_remove(reminder->timer);
+	
+	g_free(reminder->summary);
+	g_free(reminder);
+}
+
+static void on_reminder_fired(gpointer data) {
+	reminder_t *reminder = data;
+	rsource_t *rsource = reminder->rsource;
+	
+	// The wheel frees it
+	reminder->timer = NULL;
+	
+	reminders_pending_t *entry = g_new0(reminders_pending_t, 1);
+	
+	entry->summary = g_steal_pointer(&reminder->summary);
+	entry->start = reminder->start;
+	entry->is_task = (rsource->type == E_CAL_CLIENT_SOURCE_TYPE_TASKS);
+	
+	g_ptr_array_add(pending, entry);
+	g_ptr_array_remove_fast(rsource->reminders, reminder);
+	
+	trace_record(TRACE_REMINDER, "fired", pending->len, entry->is_task, 0);
+	
+	notify_changed();
+}
+
+static void rsource_add_reminder(rsource_t *rsource,
+	ECalComponent *comp, gint64 trigger, gint64 start)
+{
+	ECalComponentText *text = e_cal_component_get_summary(comp);
+	reminder_t *reminder = g_new0(reminder_t, 1);
+	
+	reminder->rsource = rsource;
+	reminder->start = start;
+	reminder->summary = g_strdup(text && e_cal_component_text_get_value(text)
+		? e_cal_component_text_get_value(text) : "");
+	
+	reminder->timer = wheel_add(trigger, on_reminder_fired, reminder);
+	g_ptr_array_add(rsource->reminders, reminder);
+	
+	g_clear_pointer(&text, e_cal_component_text_free);
+}
+
+/* Tasks due in the window, that aren't done yet. Those with alarms
+ * already got their reminders from them, the due time is for the rest. */
+static void rsource_add_due_tasks(rsource_t *rsource,
+	GSList *comps, gint64 start, gint64 end)
+{
+	ICalTimezone *default_zone = e_cal_util_get_system_timezone();
+	
+	for(GSList *l = comps; l != NULL; l = g_slist_next(l)) {
+		ECalComponent *comp = l->data;
+		
+		if(e_cal_component_has_alarms(comp)
+			|| e_cal_component_get_status(comp) == I_CAL_STATUS_COMPLETED)
+		{
+			continue;
+		}
+		
+		ECalComponentDateTime *due = e_cal_component_get_due(comp);
+		if(!due) continue;
+		
+		ICalTime *value = e_cal_component_datetime_get_value(due);
+		const gchar *tzid = e_cal_component_datetime_get_tzid(due);
+		ICalTimezone *zone = (tzid ? e_cal_client_tzlookup_cb(tzid,
+			rsource->client, NULL, NULL) : NULL);
+		
+		gint64 due_time = (value ? i_cal_time_as_timet_with_zone(value,
+			zone ? zone : default_zone) : 0);
+		
+		if(due_time > start && due_time <= end)
+			rsource_add_reminder(rsource, comp, due_time, due_time);
+		
+		e_cal_component_datetime_free(due);
+	}
+}
+
+static void on_comps_ready(GObject *source,
+	GAsyncResult *result, gpointer user_data)
+{
+	GSList *comps = NULL;
+	GError *error = NULL;
+	
+	if(!e_cal_client_get_object_list_as_comps_finish(E_CAL_CLIENT(source),
+		result, &comps, &error))
+	{
+		// Cancelled means the rsource is gone
+		if(!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_printerr("Evolution Tray: Failed to query reminders: %s\n",
+				error->message);
+		}
+		
+		g_clear_error(&error);
+		return;
+	}
+	
+	rsource_t *rsource = user_data;
+	
+	// Anything after fired_until hasn't fired yet (see the top)
+	gint64 start = MIN(fired_until, now_seconds());
+	gint64 end = now_seconds() + LOOKAHEAD_SECONDS;
+	
+	TRACE_BEGIN();
+	
+	// Replace whatever we had for the source
+	g_ptr_array_set_size(rsource->reminders, 0);
+	
+	static ECalComponentAlarmAction omit[] = {E_CAL_COMPONENT_ALARM_PROCEDURE, -1};
+	GSList *alarm_lists = NULL;
+	GList *comp_list = NULL;
+	
+	for(GSList *l = comps; l != NULL; l = g_slist_next(l))
+		comp_list = g_list_prepend(comp_list, l->data);
+	
+	e_cal_util_generate_alarms_for_list(comp_list, start, end, omit, &alarm_lists,
+		e_cal_client_tzlookup_cb, rsource->client, e_cal_util_get_system_timezone());
+	
+	for(GSList *l = alarm_lists; l != NULL; l = g_slist_next(l)) {
+		ECalComponentAlarms *alarms = l->data;
+		ECalComponent *comp = e_cal_component_alarms_get_component(alarms);
+		
+		for(GSList *i = e_cal_component_alarms_get_instances(alarms); i != NULL; i = g_slist_next(i)) {
+			gint64 trigger = e_cal_component_alarm_instance_get_time(i->data);
+			
+			// Those up to the start have fired already, or were missed
+			if(trigger > start) {
+				rsource_add_reminder(rsource, comp, trigger,
+					e_cal_component_alarm_instance_get_occur_start(i->data));
+			}
+		}
+	}
+	
+	if(rsource->type == E_CAL_CLIENT_SOURCE_TYPE_TASKS)
+		rsource_add_due_tasks(rsource, comps, start, end);
+	
+	g_slist_free_full(alarm_lists, (GDestroyNotify) e_cal_component_alarms_free);
+	g_list_free(comp_list);
+	g_slist_free_full(comps, g_object_unref);
+	
+	TRACE_END("reminders-query");
+	trace_record(TRACE_REMINDER, "loaded", rsource->reminders->len, wheel_size(), 0);
+	
+	arm();
+}
+
+static void rsource_query(rsource_t *rsource) {
+	gint64 now = now_seconds();
+	
+	gchar *start = isodate_from_time_t((time_t) MIN(fired_until, now));
+	gchar *end = isodate_from_time_t((time_t) (now + LOOKAHEAD_SECONDS));
+	gchar *sexp;
+	
+	if(rsource->type == E_CAL_CLIENT_SOURCE_TYPE_TASKS) {
+		sexp = g_strdup_printf("(or (has-alarms-in-range? (make-time \"%s\") "
+			"(make-time \"%s\")) (due-in-time-range? (make-time \"%s\") "
+			"(make-time \"%s\")))", start, end, start, end);
+	} else {
+		sexp = g_strdup_printf("(has-alarms-in-range? (make-time \"%s\") "
+			"(make-time \"%s\"))", start, end);
+	}
+	
+	e_cal_client_get_object_list_as_comps(rsource->client, sexp,
+		rsource->cancellable, on_comps_ready, rsource);
+	
+	g_free(sexp);
+	g_free(start);
+	g_free(end);
+}
+
+static void on_requery(gpointer data) {
+	rsource_t *rsource = data;
+	
+	rsource->requery_timer = NULL;
+	rsource_query(rsource);
+}
+
+static void on_view_changed(ECalClientView *view,
+	gpointer objects, rsource_t *rsource)
+{
+	if(rsource->requery_timer)
+		return;
+	
+	rsource->requery_timer = wheel_add(now_seconds() + REQUERY_DELAY_SECONDS,
+		on_requery, rsource);
+	
+	arm();
+}
+
+static void on_view_ready(GObject *source,
+	GAsyncResult *result, gpointer user_data)
+{
+	ECalClientView *view = NULL;
+	GError *error = NULL;
+	
+	if(!e_cal_client_get_view_finish(E_CAL_CLIENT(source), result, &view, &error)) {
+		if(!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_printerr("Evolution Tray: Failed to watch calendar for "
+				"changes: %s\n", error->message);
+		}
+		
+		g_clear_error(&error);
+		return;
+	}
+	
+	rsource_t *rsource = user_data;
+	GSList *fields = g_slist_prepend(NULL, (gpointer) "UID");
+	
+	rsource->view = view;
+	
+	// Only changes from now on, and we don't even care what they are
+	e_cal_client_view_set_fields_of_interest(view, fields, NULL);
+	g_slist_free(fields);
+	e_cal_client_view_set_flags(view, E_CAL_CLIENT_VIEW_FLAGS_NONE, NULL);
+	
+	g_signal_connect(view, "objects-added", G_CALLBACK(on_view_changed), rsource);
+	g_signal_connect(view, "objects-modified", G_CALLBACK(on_view_changed), rsource);
+	g_signal_connect(view, "objects-removed", G_CALLBACK(on_view_changed), rsource);
+	
+	e_cal_client_view_start(view, NULL);
+}
+
+static void on_client_connected(GObject *source,
+	GAsyncResult *result, gpointer user_data)
+{
+	GError *error = NULL;
+	
+	EClient *client = e_cal_client_connect_finish(result, &error);
+	
+	if(!client) {
+		if(!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			g_printerr("Evolution Tray: Failed to open calendar: %s\n",
+				error->message);
+		}
+		
+		g_clear_error(&error);
+		return;
+	}
+	
+	rsource_t *rsource = user_data;
+	
+	rsource->client = E_CAL_CLIENT(client);
+	
+	e_cal_client_get_view(rsource->client, "#t", rsource->cancellable,
+		on_view_ready, rsource);
+	
+	rsource_query(rsource);
+}
+
+static void rsource_free(gpointer data) {
+	rsource_t *rsource = data;
+	
+	/* Any call still in progress gets cancelled, and
+	 * won't touch the rsource, which will be gone. */
+	g_cancellable_cancel(rsource->cancellable);
+	g_object_unref(rsource->cancellable);
+	
+	if(rsource->view) {
+		g_signal_handlers_disconnect_by_data(rsource->view, rsource);
+		e_cal_client_view_stop(rsource->view, NULL);
+		g_object_unref(rsource->view);
+	}
+	
+	if(rsource->requery_timer)
+		wheel_remove(rsource->requery_timer);
+	
+	g_ptr_array_unref(rsource->reminders);
+	
+	g_clear_object(&rsource->client);
+	g_object_unref(rsource->source);
+	g_free(rsource);
+}
+
+static void add_source(ESource *source) {
+	ECalClientSourceType type;
+	
+	if(e_source_has_extension(source, E_SOURCE_EXTENSION_CALENDAR))
+		type = E_CAL_CLIENT_SOURCE_TYPE_EVENTS;
+	else if(e_source_has_extension(source, E_SOURCE_EXTENSION_TASK_LIST))
+		type = E_CAL_CLIENT_SOURCE_TYPE_TASKS;
+	else
+		return;
+	
+	const gchar *uid = e_source_get_uid(source);
+	
+	if(g_hash_table_contains(rsources, uid)
+		|| !e_source_registry_check_enabled(registry, source))
+	{
+		return;
+	}
+	
+	rsource_t *rsource = g_new0(rsource_t, 1);
+	
+	rsource->source = g_object_ref(source);
+	rsource->type = type;
+	rsource->cancellable = g_cancellable_new();
+	rsource->reminders = g_ptr_array_new_with_free_func(reminder_free);
+	
+	g_hash_table_insert(rsources, g_strdup(uid), rsource);
+	
+	e_cal_client_connect(source, type, CONNECT_TIMEOUT_SECONDS,
+		rsource->cancellable, on_client_connected, rsource);
+}
+
+static void on_source_added(ESourceRegistry *reg,
+	ESource *source, gpointer user_data)
+{
+	add_source(source);
+}
+
+static void on_source_gone(ESourceRegistry *reg,
+	ESource *source, gpointer user_data)
+{
+	if(g_hash_table_remove(rsources, e_source_get_uid(source)))
+		arm();
+}
+
+// Before the lookahead window runs out, move it forward
+static void on_reload(gpointer data) {
+	GHashTableIter iter;
+	rsource_t *rsource;
+	
+	reload_timer = wheel_add(now_seconds() + RELOAD_SECONDS, on_reload, NULL);
+	
+	g_hash_table_iter_init(&iter, rsources);
+	
+	while(g_hash_table_iter_next(&iter, NULL, (gpointer *) &rsource)) {
+		if(rsource->client)
+			rsource_query(rsource);
+	}
+}
+
+static void start(void) {
+	EShell *shell = e_shell_get_default();
+	if(!shell) return;
+	
+	registry = g_object_ref(e_shell_get_registry(shell));
+	rsources = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, rsource_free);
+	pending = g_ptr_array_new_with_free_func(pending_free);
+	
+	fired_until = now_seconds();
+	wheel_init(fired_until);
+	reload_timer = wheel_add(now_seconds() + RELOAD_SECONDS, on_reload, NULL);
+	
+	const gchar *extensions[] = {
+		E_SOURCE_EXTENSION_CALENDAR,
+		E_SOURCE_EXTENSION_TASK_LIST
+	};
+	
+	for(guint i = 0; i < G_N_ELEMENTS(extensions); i++) {
+		GList *sources = e_source_registry_list_enabled(registry, extensions[i]);
+		
+		for(GList *l = sources; l != NULL; l = g_list_next(l))
+			add_source(l->data);
+		
+		g_list_free_full(sources, g_object_unref);
+	}
+	
+	g_signal_connect(registry, "source-added", G_CALLBACK(on_source_added), NULL);
+	g_signal_connect(registry, "source-enabled", G_CALLBACK(on_source_added), NULL);
+	g_signal_connect(registry, "source-removed", G_CALLBACK(on_source_gone), NULL);
+	g_signal_connect(registry, "source-disabled", G_CALLBACK(on_source_gone), NULL);
+	
+	arm();
+	
+	active = TRUE;
+}
+
+static void stop(void) {
+	g_signal_handlers_disconnect_by_func(registry, on_source_added, NULL);
+	g_signal_handlers_disconnect_by_func(registry, on_source_gone, NULL);
+	
+	g_clear_handle_id(&timeout_id, g_source_remove);
+	armed_for = -1;
+	
+	// The rsources remove their own timers, the wheel frees the rest
+	g_clear_pointer(&rsources, g_hash_table_destroy);
+	reload_timer = NULL;
+	wheel_fini();
+	
+	g_clear_pointer(&pending, g_ptr_array_unref);
+	g_clear_object(&registry);
+	
+	active = FALSE;
+	
+	notify_changed();
+}
+
+static void on_settings_changed(GSettings *s, const gchar *key, gpointer user_data) {
+	if(!g_str_equal(key, CONF_KEY_CALENDAR_REMINDERS))
+		return;
+	
+	gboolean enabled = g_settings_get_boolean(settings, CONF_KEY_CALENDAR_REMINDERS);
+	
+	if(enabled && !active)
+		start();
+	else if(!enabled && active)
+		stop();
+}
+
+// -----------------------------
+
+// The reminders that have fired, and haven't been dismissed, oldest first
+const GPtrArray *reminders_get_pending(void) {
+	static GPtrArray *empty = NULL;
+	
+	if(pending)
+		return pending;
+	
+	if(!empty)
+		empty = g_ptr_array_new();
+	
+	return empty;
+}
+
+void reminders_dismiss(guint index) {
+	if(!pending || index >= pending->len)
+		return;
+	
+	g_ptr_array_remove_index(pending, index);
+	notify_changed();
+}
+
+void reminders_dismiss_all(void) {
+	if(!pending || pending->len == 0)
+		return;
+	
+	g_ptr_array_set_size(pending, 0);
+	notify_changed();
+}
+
+gint reminders_init(void (*changed_cb)(void)) {
+	settings = g_settings_new(TRAY_SCHEMA);
+	if(!settings) return -1;
+	
+	global_changed_cb = changed_cb;
+	
+	g_signal_connect(settings, "changed",
+		G_CALLBACK(on_settings_changed), NULL);
+	
+	if(g_settings_get_boolean(settings, CONF_KEY_CALENDAR_REMINDERS))
+		start();
+	
+	return 0;
+}
+
+void reminders_fini(void) {
+	global_changed_cb = NULL;
+	
+	if(active)
+		stop();
+	
+	if(settings) {
+		g_signal_handlers_disconnect_by_func(settings, on_settings_changed, NULL);
+		g_clear_object(&settings);
+	}
+}
@@ -0,0 +1,19 @@
+#ifndef EVOLUTION_TRAY_REMINDERS_H
+#define EVOLUTION_TRAY_REMINDERS_H
+
+typedef struct reminders_pending_t {
+	gchar *summary;
+	
+	// Start of the event, or due time of the task (time_t)
+	gint64 start;
+	gboolean is_task;
+} reminders_pending_t;
+
+gint reminders_init(void (*changed_cb)(void));
+void reminders_fini(void);
+
+const GPtrArray *reminders_get_pending(void);
+void reminders_dismiss(guint index);
+void reminders_dismiss_all(void);
+
+#endif /* EVOLUTION_TRAY_REMINDERS_H */
@@ -0,0 +1,251 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* The core of the adaptive refresh (see refresh.c): decides when each
+ * account should next be checked for new mail, based on how often new mail
+ * has actually been arriving there.
+ *
+ * For every account, we keep an exponentially decayed count of the new
+ * mails seen, i.e. the sum of n * 2^(-age / half_life) over all arrivals.
+ * Multiplied by ln(2) / half_life, this is an estimate of the arrival rate,
+ * which follows a steady rate exactly, and forgets bursts at the pace set
+ * by the half-life. Only the sum and the time it was last brought up to
+ * date are stored; decaying it to any other time is a single multiplication.
+ *
+ * The refresh interval of an account is the expected time until its next
+ * mail, i.e. 1 / rate, multiplied by idle_factor while idle, and clamped
+ * to [min_interval, max_interval]. An account nobody writes to thus ends
+ * up at max_interval, a busy one at min_interval. Its next refresh is due
+ * one interval after the last one (when the account was added, initially).
+ *
+ * There's no timer in here, nor anything else from Evolution. All times
+ * are passed in by the caller (microseconds, monotonic), which makes the
+ * scheduling deterministic, and easy to drive from a test harness or a
+ * simulation. The number of accounts is small, so the queries simply scan
+ * all of them. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include <glib.h>
+
+#include "sched.h"
+
+typedef struct saccount_t {
+	gchar *account;
+	
+	// Decayed count of arrivals, as of score_time
+	gdouble score;
+	gint64 score_time;
+	
+	gint64 last_refresh;
+	gint64 due;
+} saccount_t;
+
+// Account -> saccount_t
+static GHashTable *stable = NULL;
+
+static sched_params_t params;
+static gboolean idle = FALSE;
+
+// -----------------------------
+
+static void saccount_free(gpointer data) {
+	saccount_t *saccount = data;
+	
+	g_free(saccount->account);
+	g_free(saccount);
+}
+
+static gdouble decay(gint64 age) {
+	if(age <= 0 || params.half_life == 0)
+		return 1.0;
+	
+	return exp2(-(age / (gdouble) G_USEC_PER_SEC) / params.half_life);
+}
+
+// Arrivals per second
+static gdouble saccount_rate(saccount_t *saccount, gint64 now) {
+	if(params.half_life == 0)
+		return 0;
+	
+	return saccount->score * decay(now - saccount->score_time)
+		* G_LN2 / params.half_life;
+}
+
+// Microseconds
+static gint64 saccount_interval(saccount_t *saccount, gint64 now) {
+	gdouble rate = saccount_rate(saccount, now);
+	gdouble interval = (rate > 0 ? 1.0 / rate : params.max_interval);
+	
+	if(idle)
+		interval *= MAX(params.idle_factor, 1);
+	
+	interval = CLAMP(interval, params.min_interval, params.max_interval);
+	
+	return (gint64) (interval * G_USEC_PER_SEC);
+}
+
+static void saccount_reschedule(saccount_t *saccount, gint64 now) {
+	saccount->due = saccount->last_refresh + saccount_interval(saccount, now);
+}
+
+static void reschedule_all(gint64 now) {
+	GHashTableIter iter;
+	saccount_t *saccount;
+	
+	g_hash_table_iter_init(&iter, stable);
+	
+	while(g_hash_table_iter_next(&iter, NULL, (gpointer *) &saccount))
+		saccount_reschedule(saccount, now);
+}
+
+// -----------------------------
+
+gint sched_init(const sched_params_t *p) {
+	stable = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, saccount_free);
+	if(!stable) return -1;
+	
+	params = *p;
+	params.max_interval = MAX(params.max_interval, params.min_interval);
+	
+	idle = FALSE;
+	
+	return 0;
+}
+
+void sched_fini(void) {
+	g_clear_pointer(&stable, g_hash_table_destroy);
+	idle = FALSE;
+}
+
+void sched_set_params(const sched_params_t *p, gint64 now) {
+	params = *p;
+	params.max_interval = MAX(params.max_interval, params.min_interval);
+	
+	reschedule_all(now);
+}
+
+void sched_set_idle(gboolean is_idle, gint64 now) {
+	if(is_idle == idle)
+		return;
+	
+	idle = is_idle;
+	reschedule_all(now);
+}
+
+/* Start scheduling an account. Its first refresh is due one (maximum)
+ * interval from now, as nothing is known about it yet. */
+gboolean sched_add_account(const gchar *account, gint64 now) {
+	if(g_hash_table_contains(stable, account))
+		return FALSE;
+	
+	saccount_t *saccount = g_new0(saccount_t, 1);
+	
+	saccount->account = g_strdup(account);
+	saccount->score_time = now;
+	saccount->last_refresh = now;
+	saccount_reschedule(saccount, now);
+	
+	g_hash_table_insert(stable, saccount->account, saccount);
+	
+	return TRUE;
+}
+
+void sched_remove_account(const gchar *account) {
+	g_hash_table_remove(stable, account);
+}
+
+gboolean sched_has_account(const gchar *account) {
+	return g_hash_table_contains(stable, account);
+}
+
+// N new mails arrived in the account
+void sched_arrival(const gchar *account, guint n, gint64 now) {
+	saccount_t *saccount = g_hash_table_lookup(stable, account);
+	if(!saccount) return;
+	
+	saccount->score = saccount->score * decay(now - saccount->score_time) + n;
+	saccount->score_time = MAX(now, saccount->score_time);
+	
+	saccount_reschedule(saccount, now);
+}
+
+// The account was checked for new mail, by us or by someone else
+void sched_refreshed(const gchar *account, gint64 now) {
+	saccount_t *saccount = g_hash_table_lookup(stable, account);
+	if(!saccount) return;
+	
+	saccount->last_refresh = now;
+	saccount_reschedule(saccount, now);
+}
+
+// When the next refresh is due, or -1 if there are no accounts
+gint64 sched_next_due(void) {
+	GHashTableIter iter;
+	saccount_t *saccount;
+	
+	gint64 next = -1;
+	
+	g_hash_table_iter_init(&iter, stable);
+	
+	while(g_hash_table_iter_next(&iter, NULL, (gpointer *) &saccount)) {
+		if(next < 0 || saccount->due < next)
+			next = saccount->due;
+	}
+	
+	return next;
+}
+
+/* The account whose refresh is the most overdue, or NULL if none is due
+ * yet. The account is then considered refreshed, so that calling this
+ * repeatedly yields all due accounts, each once. */
+const gchar *sched_pop_due(gint64 now) {
+	GHashTableIter iter;
+	saccount_t *saccount, *first = NULL;
+	
+	g_hash_table_iter_init(&iter, stable);
+	
+	while(g_hash_table_iter_next(&iter, NULL, (gpointer *) &saccount)) {
+		if(saccount->due <= now && (!first || saccount->due < first->due))
+			first = saccount;
+	}
+	
+	if(!first)
+		return NULL;
+	
+	first->last_refresh = now;
+	saccount_reschedule(first, now);
+	
+	return first->account;
+}
+
+// Estimated arrivals per hour
+gdouble sched_get_rate(const gchar *account, gint64 now) {
+	saccount_t *saccount = g_hash_table_lookup(stable, account);
+	return (saccount ? saccount_rate(saccount, now) * 3600 : 0);
+}
+
+// Current refresh interval, in seconds
+gint64 sched_get_interval(const gchar *account, gint64 now) {
+	saccount_t *saccount = g_hash_table_lookup(stable, account);
+	return (saccount ? saccount_interval(saccount, now) / G_USEC_PER_SEC : -1);
+}
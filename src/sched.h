@@ -0,0 +1,35 @@
+#ifndef EVOLUTION_TRAY_SCHED_H
+#define EVOLUTION_TRAY_SCHED_H
+
+typedef struct sched_params_t {
+	// Bounds of the refresh interval, in seconds
+	guint min_interval;
+	guint max_interval;
+	
+	// Half-life of the arrival rate estimate, in seconds
+	guint half_life;
+	
+	// Interval multiplier while idle
+	guint idle_factor;
+} sched_params_t;
+
+gint sched_init(const sched_params_t *params);
+void sched_fini(void);
+
+void sched_set_params(const sched_params_t *params, gint64 now);
+void sched_set_idle(gboolean idle, gint64 now);
+
+gboolean sched_add_account(const gchar *account, gint64 now);
+void sched_remove_account(const gchar *account);
+gboolean sched_has_account(const gchar *account);
+
+void sched_arrival(const gchar *account, guint n, gint64 now);
+void sched_refreshed(const gchar *account, gint64 now);
+
+gint64 sched_next_due(void);
+const gchar *sched_pop_due(gint64 now);
+
+gdouble sched_get_rate(const gchar *account, gint64 now);
+gint64 sched_get_interval(const gchar *account, gint64 now);
+
+#endif /* EVOLUTION_TRAY_SCHED_H */
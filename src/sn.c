@@ -16,6 +16,13 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+/* The StatusNotifierItem(s) of the tray, with their DBusMenus. All items
+ * are exported on the single session bus connection set up by sn_init().
+ * There's always the primary item, and optionally more (e.g. one per
+ * account, see items.c), each with its own object path, menu path and
+ * bus name, and its own callbacks' user_data. Signals go out on the item's
+ * own object path only, so a change to one item concerns its hosts alone. */
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -23,9 +30,11 @@
 #include <gio/gio.h>
 #include <glib/gprintf.h>
 
+#include <libdbusmenu-glib/client.h>
 #include <libdbusmenu-glib/server.h>
 
 #include "sn.h"
+#include "trace.h"
 
 static const gchar introspection_xml[] =
 "<node>"
@@ -34,24 +43,68 @@ static const gchar introspection_xml[] =
 "	  <arg type='i' name='x' direction='in'/>"
 "	  <arg type='i' name='y' direction='in'/>"
 "	</method>"
+"	<method name='SecondaryActivate'>"
+"	  <arg type='i' name='x' direction='in'/>"
+"	  <arg type='i' name='y' direction='in'/>"
+"	</method>"
+"	<method name='Scroll'>"
+"	  <arg type='i' name='delta' direction='in'/>"
+"	  <arg type='s' name='orientation' direction='in'/>"
+"	</method>"
 "	<property name='Category' type='s' access='read'/>"
 "	<property name='Id' type='s' access='read'/>"
 "	<property name='Title' type='s' access='read'/>"
 "	<property name='Status' type='s' access='read'/>"
 "	<property name='IconName' type='s' access='read'/>"
+"	<property name='AttentionIconName' type='s' access='read'/>"
 "	<property name='Menu' type='o' access='read'/>"
+"	<property name='ToolTip' type='(sa(iiay)ss)' access='read'/>"
 "  </interface>"
 "</node>";
 
+typedef struct sn_item_t {
+	guint serial;
+	
+	gchar *bus_name;
+	gchar *object_path;
+	gchar *menu_path;
+	
+	gchar *id;
+	gchar *title;
+	const gchar *icon;
+	
+	// NULL unless the item needs attention
+	const gchar *attention_icon;
+	
+	// Being torn down, see sn_item_free()
+	gboolean passive;
+	
+	guint owner_id;
+	guint registration_id;
+	DbusmenuServer *menu_server;
+	DbusmenuMenuitem *menu_root;
+	
+	// The extra menu entries at the top, see sn_item_set_entries()
+	GList *entries;
+	void (*entry_cb)(guint index, gpointer user_data);
+	
+	// Supplies the tooltip text, only when it's asked for
+	const gchar *(*tooltip_cb)(gpointer user_data);
+	
+	sn_callbacks_t callbacks;
+	gpointer user_data;
+} sn_item_t;
+
 static GDBusConnection *bus = NULL;
-static guint owner_id = 0;
-static guint registration_id = 0;
+static GDBusNodeInfo *introspection_data = NULL;
 static guint subscription_id = 0;
-DbusmenuServer *menu_server = NULL;
+static gboolean watcher_present = FALSE;
 
-static const gchar *current_icon = NULL;
+// All live items, and the serial of the next one
+static GList *items = NULL;
+static guint next_serial = 1;
 
-static void register_with_watcher(void);
+static void register_with_watcher(sn_item_t *item);
 
 // -----------------------------
 
@@ -59,11 +112,31 @@ static void on_method_call(GDBusConnection *conn, const gchar *sender,
 	const gchar *object_path, const gchar *iface, const gchar *method_name,
 	GVariant *params, GDBusMethodInvocation *inv, gpointer user_data)
 {
+	sn_item_t *item = user_data;
+	
+	TRACE_BEGIN();
+	
 	if(g_strcmp0(method_name, "Activate") == 0) {
-		void (*activate_cb)(void) = (void (*)(void)) user_data;
-		activate_cb();
+		item->callbacks.activate(item->user_data);
 		
 		g_dbus_method_invocation_return_value(inv, NULL);
+		TRACE_END("sni-activate");
+	} else if(g_strcmp0(method_name, "SecondaryActivate") == 0) {
+		item->callbacks.secondary_activate(item->user_data);
+		
+		g_dbus_method_invocation_return_value(inv, NULL);
+		TRACE_END("sni-secondary-activate");
+	} else if(g_strcmp0(method_name, "Scroll") == 0) {
+		gint delta;
+		const gchar *orientation;
+		g_variant_get(params, "(i&s)", &delta, &orientation);
+		
+		// Both orientations do the same, one step per call
+		if(delta != 0)
+			item->callbacks.scroll(delta > 0 ? 1 : -1, item->user_data);
+		
+		g_dbus_method_invocation_return_value(inv, NULL);
+		TRACE_END("sni-scroll");
 	}
 }
 
@@ -71,22 +144,48 @@ static GVariant *on_get_property(GDBusConnection *conn, const gchar *sender,
 	const gchar *object_path, const gchar *interface_name, const gchar *property_name,
 	GError **error, gpointer user_data)
 {
+	sn_item_t *item = user_data;
+	
 	if(g_strcmp0(property_name, "Category") == 0)
 		return g_variant_new_string("ApplicationStatus");
 	if(g_strcmp0(property_name, "Id") == 0)
-		return g_variant_new_string("Evolution Tray");
+		return g_variant_new_string(item->id);
 	if(g_strcmp0(property_name, "Title") == 0)
-		return g_variant_new_string("Evolution Tray");
-	if(g_strcmp0(property_name, "Status") == 0)
-		return g_variant_new_string("Active");
+		return g_variant_new_string(item->title);
+	if(g_strcmp0(property_name, "Status") == 0) {
+		return g_variant_new_string(item->passive ? "Passive"
+			: item->attention_icon ? "NeedsAttention" : "Active");
+	}
 	if(g_strcmp0(property_name, "IconName") == 0)
-		return g_variant_new_string(current_icon);
+		return g_variant_new_string(item->icon);
+	if(g_strcmp0(property_name, "AttentionIconName") == 0)
+		return g_variant_new_string(item->attention_icon ? item->attention_icon : "");
 	if(g_strcmp0(property_name, "Menu") == 0)
-		return g_variant_new_object_path("/Menu");
+		return g_variant_new_object_path(item->menu_path);
+	
+	if(g_strcmp0(property_name, "ToolTip") == 0) {
+		const gchar *text = (item->tooltip_cb ? item->tooltip_cb(item->user_data) : NULL);
+		
+		// No icon, the item's own will do
+		return g_variant_new("(sa(iiay)ss)", "", NULL,
+			item->title, text ? text : "");
+	}
 	
 	return NULL;
 }
 
+static void on_name_acquired(GDBusConnection *conn,
+	const gchar *name, gpointer user_data)
+{
+	trace_record(TRACE_DBUS, "name-acquired", GPOINTER_TO_UINT(user_data), 0, 0);
+}
+
+static void on_name_lost(GDBusConnection *conn,
+	const gchar *name, gpointer user_data)
+{
+	trace_record(TRACE_DBUS, "name-lost", GPOINTER_TO_UINT(user_data), 0, 0);
+}
+
 static void on_snw_owner_changed(GDBusConnection *conn, const gchar *sender,
 	const gchar *path, const gchar *interface, const gchar *signal_name,
 	GVariant *params, gpointer user_data)
@@ -94,151 +193,353 @@ static void on_snw_owner_changed(GDBusConnection *conn, const gchar *sender,
 	const gchar *name, *old_owner, *new_owner;
 	g_variant_get(params, "(&s&s&s)", &name, &old_owner, &new_owner);
 	
+	watcher_present = (new_owner && *new_owner);
+	
+	trace_record(TRACE_DBUS, "watcher-owner-changed", watcher_present, 0, 0);
+	
 	// If there is an owner, register
-	if(new_owner && *new_owner)
-		register_with_watcher();
+	if(watcher_present) {
+		for(GList *l = items; l != NULL; l = g_list_next(l))
+			register_with_watcher(l->data);
+	}
 }
 
-static void register_with_watcher(void) {
+static void on_watcher_registered(GObject *source,
+	GAsyncResult *result, gpointer user_data)
+{
 	GError *error = NULL;
 	
-	GDBusProxy *watcher_proxy = g_dbus_proxy_new_sync(bus, G_DBUS_PROXY_FLAGS_NONE,
-		NULL, "org.kde.StatusNotifierWatcher", "/StatusNotifierWatcher",
-		"org.kde.StatusNotifierWatcher", NULL, &error);
+	GVariant *reply = g_dbus_connection_call_finish(
+		G_DBUS_CONNECTION(source), result, &error);
 	
-	if(!watcher_proxy) {
-		g_printerr("Evolution Tray: dbus: Failed to create proxy to "
-			"StatusNotifierWatcher: %s\n", error->message);
-		g_clear_error(&error);
-		return;
-	}
-	
-	g_dbus_proxy_call_sync(watcher_proxy, "RegisterStatusNotifierItem",
-		g_variant_new("(s)", DBUS_SERVICE_NAME), G_DBUS_CALL_FLAGS_NONE,
-		-1, NULL, &error);
+	trace_record(TRACE_DBUS, "watcher-register", (error == NULL),
+		GPOINTER_TO_UINT(user_data), 0);
 	
 	if(error) {
 		g_printerr("Evolution Tray: dbus: Failed to register with "
 			"StatusNotifierWatcher: %s\n", error->message);
+		g_clear_error(&error);
 	}
 	
-	g_object_unref(watcher_proxy);
-	g_clear_error(&error);
+	g_clear_pointer(&reply, g_variant_unref);
 }
 
-// -----------------------------
-
-static void on_menu_properties(DbusmenuMenuitem *mi,
-	guint timestamp, void (*menu_prefs_cb)(void))
-{
-	menu_prefs_cb();
+/* The primary item registers with its bus name, like it always has. The
+ * others share the connection, and thus also the default object path of
+ * every name we own; they register with their own bus name followed by
+ * their own object path. The watcher then drops them along with the name,
+ * which is requested before this on the same connection, so the bus has
+ * it by the time the watcher looks it up. */
+static void register_with_watcher(sn_item_t *item) {
+	gchar *service = (item->serial == 0 ? g_strdup(item->bus_name)
+		: g_strconcat(item->bus_name, item->object_path, NULL));
+	
+	g_dbus_connection_call(bus, "org.kde.StatusNotifierWatcher",
+		"/StatusNotifierWatcher", "org.kde.StatusNotifierWatcher",
+		"RegisterStatusNotifierItem", g_variant_new("(s)", service), NULL,
+		G_DBUS_CALL_FLAGS_NONE, -1, NULL, on_watcher_registered,
+		GUINT_TO_POINTER(item->serial));
+	
+	g_free(service);
 }
 
-static void on_menu_quit(DbusmenuMenuitem *mi,
-	guint timestamp, void (*menu_quit_cb)(void))
+// -----------------------------
+
+static void on_menu_item(DbusmenuMenuitem *mi,
+	guint timestamp, sn_item_t *item)
 {
-	menu_quit_cb();
+	void (*menu_cb)(gpointer) = g_object_get_data(G_OBJECT(mi), "sn-menu-cb");
+	menu_cb(item->user_data);
 }
 
-static DbusmenuMenuitem *build_menu(
-	void (*menu_prefs_cb)(void),
-	void (*menu_quit_cb)(void))
+static void menu_append(sn_item_t *sn_item, DbusmenuMenuitem *root,
+	const gchar *label, const gchar *icon_name, void (*menu_cb)(gpointer))
 {
-	DbusmenuMenuitem *root, *item;
-	
-	root = dbusmenu_menuitem_new();
-	
-	/* Properties */
-	item = dbusmenu_menuitem_new();
+	DbusmenuMenuitem *item = dbusmenu_menuitem_new();
 	
 	dbusmenu_menuitem_property_set(item,
-		DBUSMENU_MENUITEM_PROP_LABEL, "_Properties");
+		DBUSMENU_MENUITEM_PROP_LABEL, label);
 	dbusmenu_menuitem_property_set(item,
-		DBUSMENU_MENUITEM_PROP_ICON_NAME, "document-properties");
+		DBUSMENU_MENUITEM_PROP_ICON_NAME, icon_name);
 	
+	g_object_set_data(G_OBJECT(item), "sn-menu-cb", menu_cb);
 	g_signal_connect(item, DBUSMENU_MENUITEM_SIGNAL_ITEM_ACTIVATED,
-		G_CALLBACK(on_menu_properties), menu_prefs_cb);
+		G_CALLBACK(on_menu_item), sn_item);
 	
 	dbusmenu_menuitem_child_append(root, item);
 	g_object_unref(item);
-	
-	/* Quit */
-	item = dbusmenu_menuitem_new();
+}
+
+static DbusmenuMenuitem *menu_separator_new(void) {
+	DbusmenuMenuitem *item = dbusmenu_menuitem_new();
 	
 	dbusmenu_menuitem_property_set(item,
-		DBUSMENU_MENUITEM_PROP_LABEL, "_Quit");
-	dbusmenu_menuitem_property_set(item,
-		DBUSMENU_MENUITEM_PROP_ICON_NAME, "application-exit");
+		DBUSMENU_MENUITEM_PROP_TYPE, DBUSMENU_CLIENT_TYPES_SEPARATOR);
 	
-	g_signal_connect(item, DBUSMENU_MENUITEM_SIGNAL_ITEM_ACTIVATED,
-		G_CALLBACK(on_menu_quit), menu_quit_cb);
+	return item;
+}
+
+static void menu_append_separator(DbusmenuMenuitem *root) {
+	DbusmenuMenuitem *item = menu_separator_new();
 	
 	dbusmenu_menuitem_child_append(root, item);
 	g_object_unref(item);
-	
-	return root;
 }
 
-gint sn_init(const char *icon_name,
-	void (*activate_cb)(void),
-	void (*menu_prefs_cb)(void),
-	void (*menu_quit_cb)(void))
+static void on_entry_item(DbusmenuMenuitem *mi,
+	guint timestamp, sn_item_t *item)
 {
-	GDBusProxy *bus_proxy = NULL;
-	GDBusNodeInfo *introspection_data = NULL;
-	GVariant *bus_reply = NULL;
-	GError *error = NULL;
+	guint index = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(mi), "sn-entry-index"));
 	
-	bus = NULL;
+	// The callback may well replace the entries, this one included
+	g_object_ref(mi);
+	item->entry_cb(index, item->user_data);
+	g_object_unref(mi);
+}
+
+/* None of the menu actions involve the main window. In particular, New
+ * Message, Send/Receive and Mark-as-seen must not realize or present it. */
+static DbusmenuMenuitem *build_menu(sn_item_t *item) {
+	DbusmenuMenuitem *root = dbusmenu_menuitem_new();
 	
-	gint return_code = -1;
+	menu_append(item, root, "_New Message", "mail-message-new",
+		item->callbacks.menu_new_message);
+	menu_append(item, root, "_Send / Receive", "mail-send-receive",
+		item->callbacks.menu_send_receive);
+	menu_append(item, root, "_Mark New Mail as Seen", "mail-mark-read",
+		item->callbacks.menu_mark_seen);
 	
-	current_icon = icon_name;
+	menu_append_separator(root);
 	
-	// ---
+	menu_append(item, root, "_Properties", "document-properties",
+		item->callbacks.menu_prefs);
+	menu_append(item, root, "_Quit", "application-exit",
+		item->callbacks.menu_quit);
 	
-	bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
-	if(!bus) {
-		g_printerr("Evolution Tray: dbus: Failed to connect to D-Bus: %s\n",
-			error->message);
-		goto end;
-	}
+	return root;
+}
+
+// -----------------------------
+
+/* Export a new item on the shared connection. The one with a NULL id is
+ * the primary item, under DBUS_SERVICE_NAME and SNI_OBJECT_PATH; any other
+ * gets its own bus name, object path and menu path, numbered by serial. */
+sn_item_t *sn_item_new(const gchar *id, const gchar *title,
+	const gchar *icon_name, const sn_callbacks_t *callbacks, gpointer user_data)
+{
+	GError *error = NULL;
 	
-	owner_id = g_bus_own_name_on_connection(bus, DBUS_SERVICE_NAME,
-		G_BUS_NAME_OWNER_FLAGS_NONE, NULL, NULL, NULL, NULL);
+	g_return_val_if_fail(bus != NULL, NULL);
+	
+	sn_item_t *item = g_new0(sn_item_t, 1);
+	
+	item->serial = (id ? next_serial++ : 0);
+	item->icon = icon_name;
+	item->callbacks = *callbacks;
+	item->user_data = user_data;
+	
+	if(item->serial == 0) {
+		item->bus_name = g_strdup(DBUS_SERVICE_NAME);
+		item->object_path = g_strdup(SNI_OBJECT_PATH);
+		item->menu_path = g_strdup(SNI_MENU_PATH);
+		item->id = g_strdup("Evolution Tray");
+	} else {
+		item->bus_name = g_strdup_printf("%s.Item%u", DBUS_SERVICE_NAME, item->serial);
+		item->object_path = g_strdup_printf("%s/%u", SNI_OBJECT_PATH, item->serial);
+		item->menu_path = g_strdup_printf("%s/%u", SNI_MENU_PATH, item->serial);
+		item->id = g_strdup_printf("Evolution Tray %s", id);
+	}
 	
-	/* Export SNI interface */
+	item->title = g_strdup(title);
 	
-	introspection_data = g_dbus_node_info_new_for_xml(introspection_xml, &error);
+	item->owner_id = g_bus_own_name_on_connection(bus, item->bus_name,
+		G_BUS_NAME_OWNER_FLAGS_NONE, on_name_acquired, on_name_lost,
+		GUINT_TO_POINTER(item->serial), NULL);
 	
-	if(!introspection_data) {
-		g_printerr("Evolution Tray: dbus: "
-			"Failed to parse introspection xml data: %s\n", error->message);
-		goto end;
-	}
+	/* Export SNI interface */
 	
 	static const GDBusInterfaceVTable interface_vtable = {
 		.method_call = on_method_call,
 		.get_property = on_get_property
 	};
 	
-	registration_id = g_dbus_connection_register_object(bus,
-		SNI_OBJECT_PATH, introspection_data->interfaces[0],
-		&interface_vtable, activate_cb, NULL, &error);
+	item->registration_id = g_dbus_connection_register_object(bus,
+		item->object_path, introspection_data->interfaces[0],
+		&interface_vtable, item, NULL, &error);
 	
-	if(registration_id == 0) {
+	trace_record(TRACE_DBUS, "sni-register-object",
+		(item->registration_id != 0), item->serial, 0);
+	
+	if(item->registration_id == 0) {
 		g_printerr("Evolution Tray: dbus: "
 			"Failed to register object: %s\n", error->message);
-		goto end;
+		g_clear_error(&error);
+		
+		sn_item_free(item);
+		return NULL;
 	}
 	
 	/* Setup DBusMenu */
 	
-	menu_server = dbusmenu_server_new("/Menu");
-	DbusmenuMenuitem *root = build_menu(menu_prefs_cb, menu_quit_cb);
-	dbusmenu_server_set_root(menu_server, root);
-	g_object_unref(root);
-	// ---
+	item->menu_server = dbusmenu_server_new(item->menu_path);
+	item->menu_root = build_menu(item);
+	dbusmenu_server_set_root(item->menu_server, item->menu_root);
+	
+	items = g_list_prepend(items, item);
+	
+	if(watcher_present)
+		register_with_watcher(item);
+	
+	return item;
+}
+
+/* The watcher drops an item when its bus name goes away, i.e. when we unown
+ * it. Before that, the hosts still showing the item are asked to hide it
+ * (Passive), and so is any host that reads its status in the meantime. */
+void sn_item_free(sn_item_t *item) {
+	if(!item)
+		return;
+	
+	items = g_list_remove(items, item);
+	item->passive = TRUE;
+	
+	if(item->serial != 0 && item->registration_id > 0) {
+		g_dbus_connection_emit_signal(bus, NULL, item->object_path,
+			SNI_INTERFACE, "NewStatus", g_variant_new("(s)", "Passive"), NULL);
+	}
+	
+	g_list_free(item->entries);
+	g_clear_object(&item->menu_server);
+	g_clear_object(&item->menu_root);
+	
+	if(item->registration_id > 0)
+		g_dbus_connection_unregister_object(bus, item->registration_id);
+	
+	g_clear_handle_id(&item->owner_id, g_bus_unown_name);
+	
+	g_free(item->bus_name);
+	g_free(item->object_path);
+	g_free(item->menu_path);
+	g_free(item->id);
+	g_free(item->title);
+	g_free(item);
+}
+
+/* Only signals the change if there is one; the icon is then
+ * re-fetched by every host, which costs more than a comparison. */
+void sn_item_set_icon(sn_item_t *item, const gchar *icon_name) {
+	if(g_strcmp0(item->icon, icon_name) == 0)
+		return;
+	
+	item->icon = icon_name;
+	
+	g_dbus_connection_emit_signal(bus, NULL, item->object_path,
+		SNI_INTERFACE, "NewIcon", NULL, NULL);
+}
+
+const gchar *sn_item_get_icon(sn_item_t *item) {
+	return item->icon;
+}
+
+/* Raise (with the given icon) or clear (NULL) the item's attention state.
+ * Like the icon, only signalled if it changes. */
+void sn_item_set_attention(sn_item_t *item, const gchar *icon_name) {
+	if(g_strcmp0(item->attention_icon, icon_name) == 0)
+		return;
+	
+	gboolean status_changed = (!item->attention_icon != !icon_name);
+	
+	item->attention_icon = icon_name;
+	
+	if(icon_name) {
+		g_dbus_connection_emit_signal(bus, NULL, item->object_path,
+			SNI_INTERFACE, "NewAttentionIcon", NULL, NULL);
+	}
+	
+	if(status_changed) {
+		g_dbus_connection_emit_signal(bus, NULL, item->object_path, SNI_INTERFACE,
+			"NewStatus", g_variant_new("(s)", icon_name ? "NeedsAttention" : "Active"), NULL);
+	}
+}
+
+/* Replace the extra entries at the top of the item's menu (followed by a
+ * separator, if there are any). Labels are plain text, without mnemonics.
+ * Activating an entry calls entry_cb with its index, and the item's data. */
+void sn_item_set_entries(sn_item_t *item, const gchar * const *labels,
+	guint n_labels, void (*entry_cb)(guint index, gpointer user_data))
+{
+	for(GList *l = item->entries; l != NULL; l = g_list_next(l))
+		dbusmenu_menuitem_child_delete(item->menu_root, l->data);
+	
+	g_clear_pointer(&item->entries, g_list_free);
+	item->entry_cb = entry_cb;
+	
+	for(guint i = 0; i < n_labels; i++) {
+		DbusmenuMenuitem *mi = dbusmenu_menuitem_new();
+		
+		// No mnemonics, literal underscores
+		gchar **parts = g_strsplit(labels[i], "_", -1);
+		gchar *label = g_strjoinv("__", parts);
+		
+		dbusmenu_menuitem_property_set(mi, DBUSMENU_MENUITEM_PROP_LABEL, label);
+		
+		g_object_set_data(G_OBJECT(mi), "sn-entry-index", GUINT_TO_POINTER(i));
+		g_signal_connect(mi, DBUSMENU_MENUITEM_SIGNAL_ITEM_ACTIVATED,
+			G_CALLBACK(on_entry_item), item);
+		
+		dbusmenu_menuitem_child_add_position(item->menu_root, mi, i);
+		item->entries = g_list_prepend(item->entries, mi);
+		g_object_unref(mi);
+		
+		g_strfreev(parts);
+		g_free(label);
+	}
+	
+	if(n_labels > 0) {
+		DbusmenuMenuitem *mi = menu_separator_new();
+		
+		dbusmenu_menuitem_child_add_position(item->menu_root, mi, n_labels);
+		item->entries = g_list_prepend(item->entries, mi);
+		g_object_unref(mi);
+	}
+}
+
+/* Have the item's tooltip text (which may use basic markup) supplied by
+ * tooltip_cb, called with the item's data whenever the host reads it. */
+void sn_item_set_tooltip(sn_item_t *item,
+	const gchar *(*tooltip_cb)(gpointer user_data))
+{
+	item->tooltip_cb = tooltip_cb;
+}
+
+// The tooltip text changed, any host showing it should read it again
+void sn_item_tooltip_changed(sn_item_t *item) {
+	g_dbus_connection_emit_signal(bus, NULL, item->object_path,
+		SNI_INTERFACE, "NewToolTip", NULL, NULL);
+}
+
+// -----------------------------
+
+gint sn_init(void) {
+	GVariant *bus_reply = NULL;
+	GError *error = NULL;
+	
+	gint return_code = -1;
+	
+	bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+	if(!bus) {
+		g_printerr("Evolution Tray: dbus: Failed to connect to D-Bus: %s\n",
+			error->message);
+		goto end;
+	}
+	
+	introspection_data = g_dbus_node_info_new_for_xml(introspection_xml, &error);
+	
+	if(!introspection_data) {
+		g_printerr("Evolution Tray: dbus: "
+			"Failed to parse introspection xml data: %s\n", error->message);
+		goto end;
+	}
 	
 	/* Call-me-back if/when the owner of
 	 * org.kde.StatusNotifierWatcher changes */
@@ -248,22 +549,13 @@ gint sn_init(const char *icon_name,
 		"/org/freedesktop/DBus", "org.kde.StatusNotifierWatcher",
 		G_DBUS_SIGNAL_FLAGS_NONE, on_snw_owner_changed, NULL, NULL);
 	
-	/* Create a proxy and check if a watcher already exists. If not, do
-	 * nothing -- we'll call register in the NameOwnerChanged callback. */
-	
-	bus_proxy = g_dbus_proxy_new_sync(bus, G_DBUS_PROXY_FLAGS_NONE,
-		NULL, "org.freedesktop.DBus", "/org/freedesktop/DBus",
-		"org.freedesktop.DBus", NULL, &error);
-	
-	if(!bus_proxy) {
-		g_printerr("Evolution Tray: dbus: "
-			"Failed to create DBus proxy: %s\n", error->message);
-		goto end;
-	}
+	/* Check if a watcher already exists. If not, items aren't registered
+	 * as they're created -- they will be in the NameOwnerChanged callback. */
 	
-	bus_reply = g_dbus_proxy_call_sync(bus_proxy, "NameHasOwner",
+	bus_reply = g_dbus_connection_call_sync(bus, "org.freedesktop.DBus",
+		"/org/freedesktop/DBus", "org.freedesktop.DBus", "NameHasOwner",
 		g_variant_new("(s)", "org.kde.StatusNotifierWatcher"),
-		G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+		G_VARIANT_TYPE("(b)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
 	
 	if(!bus_reply) {
 		g_printerr("Evolution Tray: dbus: "
@@ -271,17 +563,12 @@ gint sn_init(const char *icon_name,
 		goto end;
 	}
 	
-	gboolean watcher_available;
-	g_variant_get(bus_reply, "(b)", &watcher_available);
-	if(watcher_available)
-		register_with_watcher();
+	g_variant_get(bus_reply, "(b)", &watcher_present);
 	
 	return_code = 0;
 	
 end:
 	
-	g_clear_object(&bus_proxy);
-	g_clear_pointer(&introspection_data, g_dbus_node_info_unref);
 	g_clear_pointer(&bus_reply, g_variant_unref);
 	g_clear_error(&error);
 	
@@ -292,29 +579,21 @@ end:
 }
 
 void sn_fini(void) {
+	while(items)
+		sn_item_free(items->data);
+	
 	if(subscription_id > 0) {
 		g_dbus_connection_signal_unsubscribe(bus, subscription_id);
 		subscription_id = 0;
 	}
 	
-	g_clear_object(&menu_server);
-	
-	if(registration_id > 0) {
-		g_dbus_connection_unregister_object(bus, registration_id);
-		registration_id = 0;
-	}
-	
-	g_clear_handle_id(&owner_id, g_bus_unown_name);
+	g_clear_pointer(&introspection_data, g_dbus_node_info_unref);
 	g_clear_object(&bus);
-}
-
-void sn_set_icon(const gchar *icon_name) {
-	current_icon = icon_name;
 	
-	g_dbus_connection_emit_signal(bus, NULL, SNI_OBJECT_PATH,
-		SNI_INTERFACE, "NewIcon", NULL, NULL);
+	watcher_present = FALSE;
+	next_serial = 1;
 }
 
-const gchar *sn_get_icon(void) {
-	return current_icon;
+GDBusConnection *sn_get_bus(void) {
+	return bus;
 }
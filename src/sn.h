@@ -4,14 +4,37 @@
 #define DBUS_SERVICE_NAME "org.gnome.evolution.plugin.evolution-tray"
 #define SNI_INTERFACE "org.kde.StatusNotifierItem"
 #define SNI_OBJECT_PATH "/StatusNotifierItem"
+#define SNI_MENU_PATH "/Menu"
 
-int sn_init(const char *icon_name,
-	void (*activate_cb)(void),
-	void (*menu_prefs_cb)(void),
-	void (*menu_quit_cb)(void));
+typedef struct sn_item_t sn_item_t;
 
+// All callbacks get the user_data of the item they were invoked on
+typedef struct sn_callbacks_t {
+	void (*activate)(gpointer user_data);
+	void (*secondary_activate)(gpointer user_data);
+	void (*scroll)(gint direction, gpointer user_data);
+	
+	void (*menu_new_message)(gpointer user_data);
+	void (*menu_send_receive)(gpointer user_data);
+	void (*menu_mark_seen)(gpointer user_data);
+	void (*menu_prefs)(gpointer user_data);
+	void (*menu_quit)(gpointer user_data);
+} sn_callbacks_t;
+
+int sn_init(void);
 void sn_fini(void);
-void sn_set_icon(const gchar *icon_name);
-const gchar *sn_get_icon(void);
+GDBusConnection *sn_get_bus(void);
+
+sn_item_t *sn_item_new(const gchar *id, const gchar *title,
+	const gchar *icon_name, const sn_callbacks_t *callbacks, gpointer user_data);
+void sn_item_free(sn_item_t *item);
+void sn_item_set_icon(sn_item_t *item, const gchar *icon_name);
+const gchar *sn_item_get_icon(sn_item_t *item);
+void sn_item_set_attention(sn_item_t *item, const gchar *icon_name);
+void sn_item_set_entries(sn_item_t *item, const gchar * const *labels,
+	guint n_labels, void (*entry_cb)(guint index, gpointer user_data));
+void sn_item_set_tooltip(sn_item_t *item,
+	const gchar *(*tooltip_cb)(gpointer user_data));
+void sn_item_tooltip_changed(sn_item_t *item);
 
 #endif /* EVOLUTION_TRAY_SN_H */
@@ -0,0 +1,121 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* The flight recorder: a fixed-size ring of the plugin's most recent
+ * happenings (status changes, ucount counter changes, D-Bus outcomes,
+ * handler timings), always on, in release builds too.
+ *
+ * Recording must be cheap enough to not think twice about it, so a record
+ * is just a timestamp and a few integers, written into the next slot of a
+ * static ring. There's no allocation and no locking; everything that we
+ * record happens in the main thread. The label of a record must be a string
+ * literal (we only keep the pointer).
+ *
+ * When something weird happens, the ring can be dumped, either over D-Bus
+ * (DumpTrace, see api.c), or to stderr by sending SIGUSR1 to evolution. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <signal.h>
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <glib/gprintf.h>
+
+#include "trace.h"
+
+static trace_record_t ring[TRACE_SIZE];
+
+// Total number of records ever written. The next one goes to pos % size.
+static guint64 pos = 0;
+
+static guint sigusr1_id = 0;
+
+static const gchar *type_names[TRACE_N_TYPES] = {
+	[TRACE_STATUS] = "status",
+	[TRACE_UCOUNT_EVENT] = "ucount-event",
+	[TRACE_UCOUNT_CHECKPOINT] = "ucount-checkpoint",
+	[TRACE_UCOUNT_SEED] = "ucount-seed",
+	[TRACE_UCOUNT_ACCOUNT] = "ucount-account",
+	[TRACE_DBUS] = "dbus",
+	[TRACE_HANDLER] = "handler",
+	[TRACE_WINDOW] = "window",
+	[TRACE_REFRESH] = "refresh",
+	[TRACE_REMINDER] = "reminder",
+	[TRACE_INIT] = "init",
+};
+
+void trace_record(trace_type_t type, const gchar *what, gint a, gint b, gint c) {
+	trace_record_t *record = &ring[pos++ & (TRACE_SIZE - 1)];
+	
+	*record = (trace_record_t) {
+		.time = g_get_monotonic_time(),
+		.type = type,
+		.what = what,
+		.a = a, .b = b, .c = c
+	};
+}
+
+const gchar *trace_type_name(trace_type_t type) {
+	return (type < TRACE_N_TYPES ? type_names[type] : "?");
+}
+
+/* Copy out the (up to) max_records most recent
+ * records, oldest first. Returns how many. */
+guint trace_snapshot(trace_record_t *records, guint max_records) {
+	guint n = MIN(MIN(pos, TRACE_SIZE), max_records);
+	
+	for(guint i = 0; i < n; i++)
+		records[i] = ring[(pos - n + i) & (TRACE_SIZE - 1)];
+	
+	return n;
+}
+
+void trace_dump(void) {
+	guint n = MIN(pos, TRACE_SIZE);
+	gint64 now = g_get_monotonic_time();
+	
+	g_printerr("Evolution Tray: trace: %u records (%" G_GUINT64_FORMAT
+		" total), times relative to now\n", n, pos);
+	
+	for(guint i = 0; i < n; i++) {
+		trace_record_t *r = &ring[(pos - n + i) & (TRACE_SIZE - 1)];
+		
+		g_printerr("  %12.6f %-18s %-24s %d %d %d\n",
+			(r->time - now) / 1e6, trace_type_name(r->type),
+			r->what ? r->what : "", r->a, r->b, r->c);
+	}
+}
+
+static gboolean on_sigusr1(gpointer user_data) {
+	trace_dump();
+	return G_SOURCE_CONTINUE;
+}
+
+void trace_init(void) {
+	if(!sigusr1_id)
+		sigusr1_id = g_unix_signal_add(SIGUSR1, on_sigusr1, NULL);
+}
+
+/* The records are kept, in case the plugin is enabled again. Nothing
+ * else to free, really, only stop listening for the dump signal. */
+void trace_fini(void) {
+	g_clear_handle_id(&sigusr1_id, g_source_remove);
+}
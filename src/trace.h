@@ -0,0 +1,67 @@
+#ifndef EVOLUTION_TRAY_TRACE_H
+#define EVOLUTION_TRAY_TRACE_H
+
+// Records kept in the ring. Must be a power of 2.
+#define TRACE_SIZE 4096
+
+typedef enum {
+	TRACE_STATUS,
+	TRACE_UCOUNT_EVENT,
+	TRACE_UCOUNT_CHECKPOINT,
+	TRACE_UCOUNT_SEED,
+	TRACE_UCOUNT_ACCOUNT,
+	TRACE_DBUS,
+	TRACE_HANDLER,
+	TRACE_WINDOW,
+	TRACE_REFRESH,
+	TRACE_REMINDER,
+	TRACE_INIT,
+	
+	TRACE_N_TYPES
+} trace_type_t;
+
+typedef struct trace_record_t {
+	gint64 time;
+	trace_type_t type;
+	
+	// A string literal, never freed
+	const gchar *what;
+	
+	gint a, b, c;
+} trace_record_t;
+
+void trace_init(void);
+void trace_fini(void);
+
+void trace_record(trace_type_t type, const gchar *what, gint a, gint b, gint c);
+
+guint trace_snapshot(trace_record_t *records, guint max_records);
+const gchar *trace_type_name(trace_type_t type);
+void trace_dump(void);
+
+/* Time a handler, recording its duration in microseconds. Usage:
+ *   TRACE_BEGIN();
+ *   ...
+ *   TRACE_END("name"); */
+#define TRACE_BEGIN() gint64 trace_begin_time_ = g_get_monotonic_time()
+#define TRACE_END(what) trace_record(TRACE_HANDLER, (what), \
+	(gint) (g_get_monotonic_time() - trace_begin_time_), 0, 0)
+
+/* Time the stages of a sequence (e.g. init), each record holding the
+ * microseconds of its own stage, and the total so far. Usage:
+ *   TRACE_STAGES_BEGIN();
+ *   ...
+ *   TRACE_STAGE("first");
+ *   ...
+ *   TRACE_STAGE("second"); */
+#define TRACE_STAGES_BEGIN() gint64 trace_stages_begin_time_ = g_get_monotonic_time(), \
+	trace_stage_begin_time_ = trace_stages_begin_time_
+#define TRACE_STAGE(what) do { \
+	gint64 trace_stage_end_time_ = g_get_monotonic_time(); \
+	trace_record(TRACE_INIT, (what), \
+		(gint) (trace_stage_end_time_ - trace_stage_begin_time_), \
+		(gint) (trace_stage_end_time_ - trace_stages_begin_time_), 0); \
+	trace_stage_begin_time_ = trace_stage_end_time_; \
+} while(0)
+
+#endif /* EVOLUTION_TRAY_TRACE_H */
@@ -23,6 +23,11 @@
 #endif
 
 #include <string.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
 
 #include <gtk/gtk.h>
 #include <glib.h>
@@ -34,19 +39,69 @@
 #include <shell/e-shell-view.h>
 #include <shell/e-shell-window.h>
 #include <mail/em-event.h>
+#include <mail/em-folder-tree.h>
 
 #include "sn.h"
 #include "ucount.h"
+#include "accounts.h"
+#include "composer.h"
+#include "api.h"
+#include "counterpage.h"
+#include "trace.h"
+#include "refresh.h"
+#include "items.h"
+#include "reminders.h"
 #include "properties.h"
 
 #define ICON_READ "mail-read"
 #define ICON_UNREAD "mail-unread"
+#define ICON_REMINDER "appointment-soon"
+
+// Pending reminders listed in the menu, at most
+#define MAX_REMINDER_ENTRIES 10
+
+// New mails listed in the tooltip, at most
+#define TOOLTIP_MESSAGES 5
+
+/* Once the main window has been hidden for this long, release
+ * what we only keep around to make the next interaction faster. */
+#define HIDDEN_GRACE_SECONDS 600
+
+/* Background mode: how long after destroying the main window
+ * to measure the memory that this gave back. */
+#define RSS_SETTLE_SECONDS 5
 
 static EShellWindow *shell_window = NULL;
+static sn_item_t *main_item = NULL;
 
 static gboolean initialized = FALSE;
 static gboolean hide_startup = FALSE;
 
+static guint hidden_timeout_id = 0;
+
+/* Background mode. The shell window has been destroyed (shell_window is
+ * NULL), and we hold the application, so that it doesn't quit. */
+static gboolean app_held = FALSE;
+static gint64 rss_before_destroy = 0;
+static guint rss_settle_id = 0;
+static gint64 rebuild_start_time = 0;
+
+/* The folders with new mail, as of the first scroll on the icon, and
+ * the one we're at. Forgotten on new mail, or when the window is hidden.
+ * For an account item's icon, only the folders of its accounts. */
+static GPtrArray *scroll_folders = NULL;
+static items_group_t *scroll_group = NULL;
+static guint scroll_pos = 0;
+
+// The number of reminders in the menu, the Dismiss entry follows
+static guint n_reminder_entries = 0;
+
+/* The tooltip, as of the given generation of ucount's new mails, and the
+ * generation that the host was last told about. See on_tooltip(). */
+static gchar *tooltip_text = NULL;
+static guint64 tooltip_generation = 0;
+static guint64 notified_generation = 0;
+
 static enum {
 	STATUS_READ,
 	STATUS_UNREAD
@@ -54,6 +109,73 @@ static enum {
 
 // -----------------------------
 
+/* The host asks for the tooltip: the latest new mails, which only now get
+ * looked up in their folders. Kept until ucount's list of them changes. */
+static const gchar *on_tooltip(gpointer user_data) {
+	guint64 generation = ucount_get_messages_generation();
+	
+	if(tooltip_text && generation == tooltip_generation)
+		return tooltip_text;
+	
+	TRACE_BEGIN();
+	
+	ucount_message_t messages[TOOLTIP_MESSAGES];
+	guint n_messages = ucount_get_messages(messages, TOOLTIP_MESSAGES);
+	GString *text = g_string_new(NULL);
+	
+	for(guint i = 0; i < n_messages; i++) {
+		gchar *sender = NULL, *subject = NULL;
+		
+		if(!accounts_describe_message(messages[i].folder,
+			messages[i].uid, &sender, &subject))
+		{
+			continue;
+		}
+		
+		gchar *line = g_markup_printf_escaped("%s: %s", sender ? sender : "",
+			subject && *subject ? subject : _("(No Subject)"));
+		
+		if(text->len > 0)
+			g_string_append_c(text, '\n');
+		g_string_append(text, line);
+		
+		g_free(line);
+		g_free(sender);
+		g_free(subject);
+	}
+	
+	g_free(tooltip_text);
+	tooltip_text = g_string_free(text, FALSE);
+	tooltip_generation = generation;
+	
+	TRACE_END("tooltip");
+	
+	return tooltip_text;
+}
+
+/* Tell the host if the tooltip might have changed. It's
+ * only built if (and when) the host reads it again. */
+static void tooltip_check(void) {
+	guint64 generation = ucount_get_messages_generation();
+	
+	if(generation != notified_generation) {
+		notified_generation = generation;
+		sn_item_tooltip_changed(main_item);
+	}
+}
+
+/* Let any outside consumers know that the
+ * counts and/or the read status changed. */
+static void publish(void) {
+	ucount_totals_t totals;
+	ucount_get_totals(&totals);
+	
+	counterpage_update(totals.unread, totals.new, status == STATUS_UNREAD);
+	api_counts_changed();
+	
+	tooltip_check();
+}
+
 static void hide_window(void) {
 	gtk_widget_hide(GTK_WIDGET(shell_window));
 }
@@ -62,9 +184,131 @@ static void show_window(void) {
 	gtk_widget_show(GTK_WIDGET(shell_window));
 }
 
+static void connect_window_signals(void);
+static void disconnect_window_signals(void);
+static void forget_scroll_folders(void);
+static void on_window_show(GtkWidget *widget, gpointer user_data);
+
+// Resident set size, in KiB, or -1
+static gint64 get_rss_kib(void) {
+	gchar *contents = NULL;
+	gint64 rss = -1;
+	
+	if(g_file_get_contents("/proc/self/statm", &contents, NULL, NULL)) {
+		gchar **fields = g_strsplit(contents, " ", 3);
+		
+		if(fields[0] && fields[1])
+			rss = g_ascii_strtoll(fields[1], NULL, 10) * (sysconf(_SC_PAGESIZE) / 1024);
+		
+		g_strfreev(fields);
+	}
+	
+	g_free(contents);
+	
+	return rss;
+}
+
+static gboolean on_rss_settled(gpointer user_data) {
+	rss_settle_id = 0;
+	
+#if defined(__GLIBC__)
+	// Give back what the widgets left behind in the heap
+	malloc_trim(0);
+#endif
+	
+	gint64 rss_after = get_rss_kib();
+	
+	if(rss_before_destroy >= 0 && rss_after >= 0) {
+		gint64 saved = rss_before_destroy - rss_after;
+		
+		g_message("Evolution Tray: Background mode: Main window released, "
+			"RSS %" G_GINT64_FORMAT " -> %" G_GINT64_FORMAT " KiB (%" G_GINT64_FORMAT
+			" KiB saved)", rss_before_destroy, rss_after, saved);
+		
+		trace_record(TRACE_WINDOW, "rss-saved-kib", (gint) saved, 0, 0);
+		api_set_background_stats(MAX(saved, 0), -1);
+	}
+	
+	return G_SOURCE_REMOVE;
+}
+
+/* Background mode: let go of the whole shell window, with its views and
+ * web views. The shell, the mail session and all of our own state (icon,
+ * ucount, etc.) live on, so a new window can be built later, on demand. */
+static void destroy_window(void) {
+	EShell *shell = e_shell_get_default();
+	
+	rss_before_destroy = get_rss_kib();
+	trace_record(TRACE_WINDOW, "destroy", (gint) rss_before_destroy, 0, 0);
+	
+	// With no windows left, the application would otherwise quit
+	if(!app_held) {
+		g_application_hold(G_APPLICATION(shell));
+		app_held = TRUE;
+	}
+	
+	forget_scroll_folders();
+	disconnect_window_signals();
+	
+	gtk_widget_destroy(GTK_WIDGET(shell_window));
+	shell_window = NULL;
+	
+	g_clear_handle_id(&rss_settle_id, g_source_remove);
+	rss_settle_id = g_timeout_add_seconds(RSS_SETTLE_SECONDS, on_rss_settled, NULL);
+}
+
+static gboolean on_rebuilt_window_mapped(GtkWidget *widget,
+	GdkEvent *event, gpointer user_data)
+{
+	gint64 latency = g_get_monotonic_time() - rebuild_start_time;
+	
+	g_signal_handlers_disconnect_by_func(widget, on_rebuilt_window_mapped, NULL);
+	
+	g_message("Evolution Tray: Background mode: Main window "
+		"rebuilt in %.1f ms", latency / 1000.0);
+	
+	trace_record(TRACE_WINDOW, "rebuild-latency-us", (gint) latency, 0, 0);
+	api_set_background_stats(-1, latency);
+	
+	return FALSE;
+}
+
+/* Background mode: bring back a (new) main window, in the mail view,
+ * hooked up just like the one we got in init(). */
+static void rebuild_window(void) {
+	EShell *shell = e_shell_get_default();
+	
+	rebuild_start_time = g_get_monotonic_time();
+	trace_record(TRACE_WINDOW, "rebuild", 0, 0, 0);
+	
+	g_clear_handle_id(&rss_settle_id, g_source_remove);
+	
+	shell_window = E_SHELL_WINDOW(e_shell_create_shell_window(shell, "mail"));
+	
+	connect_window_signals();
+	g_signal_connect(shell_window, "map-event",
+		G_CALLBACK(on_rebuilt_window_mapped), NULL);
+	
+	if(app_held) {
+		g_application_release(G_APPLICATION(shell));
+		app_held = FALSE;
+	}
+	
+	/* The shell might have shown the window already, before
+	 * we were there to see it. If so, catch up on that. */
+	if(gtk_widget_get_visible(GTK_WIDGET(shell_window)))
+		on_window_show(GTK_WIDGET(shell_window), NULL);
+	else
+		show_window();
+	
+	gtk_window_present(GTK_WINDOW(shell_window));
+}
+
 static void set_read(gboolean set_checkpoint) {
 	if(status == STATUS_UNREAD) {
-		sn_set_icon(ICON_READ);
+		trace_record(TRACE_STATUS, "read", set_checkpoint, 0, 0);
+		
+		sn_item_set_icon(main_item, ICON_READ);
 		status = STATUS_READ;
 		
 		/* We are now in the 'read' status. The user now knows about
@@ -73,13 +317,21 @@ static void set_read(gboolean set_checkpoint) {
 		 * See also comments in ucount.c. */
 		if(set_checkpoint)
 			ucount_set_checkpoint();
+		
+		items_checkpoint();
+		
+		publish();
 	}
 }
 
 static void set_unread(void) {
 	if(status == STATUS_READ) {
-		sn_set_icon(ICON_UNREAD);
+		trace_record(TRACE_STATUS, "unread", 0, 0, 0);
+		
+		sn_item_set_icon(main_item, ICON_UNREAD);
 		status = STATUS_UNREAD;
+		
+		publish();
 	}
 }
 
@@ -89,6 +341,27 @@ static void on_ucount_checkpoint(void) {
 	set_read(FALSE);
 }
 
+/* Called once the startup unread counts of all accounts are in. If some
+ * mail arrived while we were starting up, we know about it now. */
+static void on_accounts_seeded(const ucount_seed_t *seeds, guint n_seeds,
+	guint64 epoch)
+{
+	if(ucount_seed(seeds, n_seeds, epoch) > 0)
+		set_unread();
+	
+	items_refresh();
+	
+	publish();
+}
+
+/* An account was disabled or removed, its mail no longer concerns us */
+static void on_account_removed(const gchar *account) {
+	refresh_account_removed(account);
+	ucount_remove_account(account);
+	items_account_removed(account);
+	publish();
+}
+
 static void switch_mail_view(void) {
 	e_shell_window_set_active_view(shell_window, "mail");
 }
@@ -97,7 +370,22 @@ static gboolean in_mail_view(void) {
 	return g_str_equal(e_shell_window_get_active_view(shell_window), "mail");
 }
 
-static void on_activate(void) {
+static void on_secondary_activate(gpointer user_data);
+
+static void on_activate(gpointer user_data) {
+	// An account's icon: go to that account's new mail
+	if(user_data) {
+		on_secondary_activate(user_data);
+		return;
+	}
+	
+	/* Background mode: the window is gone, build a new one. It comes up
+	 * in the mail view, which is what we want if there's new mail. */
+	if(!shell_window) {
+		rebuild_window();
+		return;
+	}
+	
 	GdkWindow *gdk_window = gtk_widget_get_window(GTK_WIDGET(shell_window));
 	GdkWindowState window_state = gdk_window_get_state(gdk_window);
 	
@@ -130,12 +418,216 @@ static void on_activate(void) {
 	}
 }
 
-static void do_properties(void) {
+/* Bring up the window, with the given folder selected in the mail view */
+static void open_folder(const gchar *folder_uri) {
+	EMFolderTree *folder_tree = NULL;
+	
+	if(!shell_window)
+		rebuild_window();
+	
+	if(!gtk_widget_get_visible(GTK_WIDGET(shell_window)))
+		show_window();
+	
+	gtk_window_present(GTK_WINDOW(shell_window));
+	switch_mail_view();
+	
+	EShellView *shell_view = e_shell_window_get_shell_view(shell_window, "mail");
+	EShellSidebar *shell_sidebar = e_shell_view_get_shell_sidebar(shell_view);
+	
+	g_object_get(shell_sidebar, "folder-tree", &folder_tree, NULL);
+	
+	if(folder_tree) {
+		em_folder_tree_set_selected(folder_tree, folder_uri, FALSE);
+		g_object_unref(folder_tree);
+	}
+}
+
+static void on_reminder_entry(guint index, gpointer user_data) {
+	const GPtrArray *pending = reminders_get_pending();
+	
+	if(index >= n_reminder_entries || index >= pending->len) {
+		reminders_dismiss_all();
+		return;
+	}
+	
+	const reminders_pending_t *entry = g_ptr_array_index(pending, index);
+	const gchar *view = (entry->is_task ? "tasks" : "calendar");
+	
+	if(!shell_window)
+		rebuild_window();
+	
+	if(!gtk_widget_get_visible(GTK_WIDGET(shell_window)))
+		show_window();
+	
+	gtk_window_present(GTK_WINDOW(shell_window));
+	e_shell_window_set_active_view(shell_window, view);
+	
+	reminders_dismiss(index);
+}
+
+/* Reminders fired or were dismissed: draw attention to the main
+ * icon while any are pending, and list them at the top of its menu. */
+static void on_reminders_changed(void) {
+	const GPtrArray *pending = reminders_get_pending();
+	
+	n_reminder_entries = MIN(pending->len, MAX_REMINDER_ENTRIES);
+	
+	if(pending->len == 0) {
+		sn_item_set_attention(main_item, NULL);
+		sn_item_set_entries(main_item, NULL, 0, NULL);
+		return;
+	}
+	
+	gchar **labels = g_new0(gchar *, n_reminder_entries + 2);
+	GDateTime *now = g_date_time_new_now_local();
+	
+	for(guint i = 0; i < n_reminder_entries; i++) {
+		const reminders_pending_t *entry = g_ptr_array_index(pending, i);
+		GDateTime *start = g_date_time_new_from_unix_local(entry->start);
+		
+		// Just the time for today, otherwise also the day
+		gboolean today = (g_date_time_get_day_of_year(start) == g_date_time_get_day_of_year(now)
+			&& g_date_time_get_year(start) == g_date_time_get_year(now));
+		gchar *when = g_date_time_format(start, today ? "%H:%M" : "%a %H:%M");
+		
+		labels[i] = g_strdup_printf("%s %s", when, *entry->summary
+			? entry->summary : _("(No Summary)"));
+		
+		g_free(when);
+		g_date_time_unref(start);
+	}
+	
+	labels[n_reminder_entries] = g_strdup(_("Dismiss Reminders"));
+	
+	sn_item_set_entries(main_item, (const gchar * const *) labels,
+		n_reminder_entries + 1, on_reminder_entry);
+	sn_item_set_attention(main_item, ICON_REMINDER);
+	
+	g_date_time_unref(now);
+	g_strfreev(labels);
+}
+
+/* The folders with new mail, most recent first, or only
+ * those of the group's accounts. Free with g_ptr_array_unref(). */
+static GPtrArray *ref_recent(items_group_t *group) {
+	GPtrArray *recent = ucount_ref_recent();
+	
+	for(guint i = 0; group && i < recent->len;) {
+		gchar *account = ucount_folder_account(g_ptr_array_index(recent, i));
+		
+		if(items_group_has_account(group, account))
+			i++;
+		else
+			g_ptr_array_remove_index(recent, i);
+		
+		g_free(account);
+	}
+	
+	return recent;
+}
+
+/* Middle click: Go to the folder that most recently got new mail */
+static void on_secondary_activate(gpointer user_data) {
+	gchar *folder = NULL;
+	
+	/* Copy, as bringing up the window
+	 * might well set a new checkpoint. */
+	if(!user_data)
+		folder = g_strdup(ucount_get_recent());
+	else {
+		GPtrArray *recent = ref_recent(user_data);
+		
+		if(recent->len > 0)
+			folder = g_strdup(g_ptr_array_index(recent, 0));
+		
+		g_ptr_array_unref(recent);
+	}
+	
+	if(folder)
+		open_folder(folder);
+	else if(!shell_window)
+		rebuild_window();
+	else if(!gtk_widget_get_visible(GTK_WIDGET(shell_window))
+		|| !gtk_window_is_active(GTK_WINDOW(shell_window)))
+	{
+		show_window();
+		gtk_window_present(GTK_WINDOW(shell_window));
+		switch_mail_view();
+	}
+	
+	g_free(folder);
+}
+
+static void forget_scroll_folders(void) {
+	g_clear_pointer(&scroll_folders, g_ptr_array_unref);
+	scroll_group = NULL;
+	scroll_pos = 0;
+}
+
+/* Scroll: Cycle through the folders with new mail. The list is taken
+ * when the scrolling begins, as going to the first folder will typically
+ * acknowledge all new mail (i.e. set the checkpoint, emptying the list). */
+static void on_scroll(gint direction, gpointer user_data) {
+	// Scrolling moved on to another icon
+	if(scroll_folders && scroll_group != user_data)
+		forget_scroll_folders();
+	
+	if(!scroll_folders) {
+		scroll_folders = ref_recent(user_data);
+		scroll_group = user_data;
+		scroll_pos = 0;
+		
+		if(scroll_folders->len == 0) {
+			forget_scroll_folders();
+			return;
+		}
+	} else {
+		guint n = scroll_folders->len;
+		scroll_pos = (scroll_pos + n + direction) % n;
+	}
+	
+	open_folder(g_ptr_array_index(scroll_folders, scroll_pos));
+}
+
+static void do_new_message(gpointer user_data) {
+	composer_open();
+}
+
+static void do_send_receive(gpointer user_data) {
+	accounts_send_receive();
+	refresh_all_refreshed();
+}
+
+/* Acknowledge all new mail, as if the user had looked at it. From an
+ * account's icon, only the new mail of that account (if that was all
+ * the new mail, the checkpoint is reached, see on_ucount_checkpoint). */
+static void do_mark_seen(gpointer user_data) {
+	if(user_data) {
+		items_group_set_checkpoint(user_data);
+		publish();
+		return;
+	}
+	
+	ucount_set_checkpoint();
+	set_read(FALSE);
+	
+	// Might have been in the 'read' status already
+	publish();
+}
+
+static void do_properties(gpointer user_data) {
 	properties_show();
 }
 
-static void do_quit(void) {
+static void do_quit(gpointer user_data) {
 	EShell *shell = e_shell_get_default();
+	
+	// Background mode: don't keep the application alive past its last window
+	if(app_held) {
+		g_application_release(G_APPLICATION(shell));
+		app_held = FALSE;
+	}
+	
 	e_shell_quit(shell, E_SHELL_QUIT_ACTION);
 }
 
@@ -154,6 +646,20 @@ static gboolean on_widget_deleted(GtkWidget *widget,
 	return FALSE;
 }
 
+/* The main window was closed for real (not hidden), and evolution is on its
+ * way out. Let go of the window, and of anything that would keep evolution
+ * alive. Not called for our own destroy_window(), which disconnects first. */
+static void on_window_destroyed(GtkWidget *widget, gpointer user_data) {
+	trace_record(TRACE_WINDOW, "destroyed", 0, 0, 0);
+	
+	disconnect_window_signals();
+	g_clear_handle_id(&hidden_timeout_id, g_source_remove);
+	forget_scroll_folders();
+	composer_release();
+	
+	shell_window = NULL;
+}
+
 static gboolean on_window_state_event(GtkWidget *widget,
 	GdkEventWindowState *event)
 {
@@ -180,7 +686,37 @@ static gboolean on_window_state_event(GtkWidget *widget,
 	return FALSE;
 }
 
+static gboolean on_hidden_timeout(gpointer user_data) {
+	hidden_timeout_id = 0;
+	
+	composer_release();
+	
+	// Nobody's looking, new mail can wait a little longer
+	refresh_set_idle(TRUE);
+	
+	if(shell_window && is_part_enabled(TRAY_SCHEMA, CONF_KEY_BACKGROUND_MODE)
+		&& !gtk_widget_get_visible(GTK_WIDGET(shell_window)))
+	{
+		destroy_window();
+	}
+	
+	return G_SOURCE_REMOVE;
+}
+
+static void on_window_hide(GtkWidget *widget, gpointer user_data) {
+	forget_scroll_folders();
+	
+	if(!hidden_timeout_id) {
+		hidden_timeout_id = g_timeout_add_seconds(HIDDEN_GRACE_SECONDS,
+			on_hidden_timeout, NULL);
+	}
+}
+
 static void on_window_show(GtkWidget *widget, gpointer user_data) {
+	g_clear_handle_id(&hidden_timeout_id, g_source_remove);
+	refresh_set_idle(FALSE);
+	composer_warm();
+	
 	/* If enabled, the first time the evolution
 	 * window is shown, hide it to the tray. */
 	if(hide_startup) {
@@ -213,11 +749,37 @@ void org_gnome_mail_folder_unread_updated(EPlugin *ep,
 	if(t->unread == (guint) -1)
 		return;
 	
+	TRACE_BEGIN();
+	
 	// Update our internal per-folder unread count record
 	gint delta = ucount_event(t->folder_uri, t->unread);
 	
-	if(delta > 0)
+	if(delta > 0) {
 		set_unread();
+		forget_scroll_folders();
+		refresh_arrival(t->folder_uri, delta);
+	}
+	
+	if(delta != 0)
+		items_folder_changed(t->folder_uri);
+	
+	publish();
+	
+	TRACE_END("unread-updated");
+}
+
+/* A folder got new mail. Of the new mails, we're told the UID of one (the
+ * latest), and keep it around for the tooltip. That's all we ever store. */
+void org_gnome_mail_new_notify(EPlugin *ep, EMEventTargetFolder *t) {
+	if(!initialized || t->new == 0 || !t->msg_uid)
+		return;
+	
+	gchar *folder_uri = e_mail_folder_uri_build(t->store, t->folder_name);
+	
+	ucount_message(folder_uri, t->msg_uid);
+	tooltip_check();
+	
+	g_free(folder_uri);
 }
 
 // -----------------------------
@@ -236,9 +798,48 @@ static EShellWindow *find_shell_window(void) {
 	return NULL;
 }
 
+static void connect_window_signals(void) {
+	g_signal_connect(G_OBJECT(shell_window), "show",
+		G_CALLBACK(on_window_show), NULL);
+	
+	g_signal_connect(G_OBJECT(shell_window), "hide",
+		G_CALLBACK(on_window_hide), NULL);
+	
+	g_signal_connect(G_OBJECT(shell_window), "focus-in-event",
+		G_CALLBACK(on_window_focus_in), NULL);
+	
+	g_signal_connect(G_OBJECT(shell_window), "window-state-event",
+			G_CALLBACK(on_window_state_event), NULL);
+	
+	g_signal_connect(G_OBJECT(shell_window), "delete-event",
+		G_CALLBACK(on_widget_deleted), NULL);
+	
+	g_signal_connect(G_OBJECT(shell_window), "notify::active-view",
+		G_CALLBACK(on_active_view_change), NULL);
+	
+	g_signal_connect(G_OBJECT(shell_window), "destroy",
+		G_CALLBACK(on_window_destroyed), NULL);
+}
+
+static void disconnect_window_signals(void) {
+	g_signal_handlers_disconnect_by_func(shell_window, on_window_show, NULL);
+	g_signal_handlers_disconnect_by_func(shell_window, on_window_hide, NULL);
+	g_signal_handlers_disconnect_by_func(shell_window, on_window_focus_in, NULL);
+	g_signal_handlers_disconnect_by_func(shell_window, on_window_state_event, NULL);
+	g_signal_handlers_disconnect_by_func(shell_window, on_widget_deleted, NULL);
+	
+	g_signal_handlers_disconnect_by_func(shell_window, on_active_view_change, NULL);
+	g_signal_handlers_disconnect_by_func(shell_window, on_rebuilt_window_mapped, NULL);
+	g_signal_handlers_disconnect_by_func(shell_window, on_window_destroyed, NULL);
+}
+
+/* Every stage is timed in the flight recorder, which is
+ * how the benchmarks (see bench/) see the cost of each. */
 static gint init(void) {
 	gint err;
 	
+	TRACE_STAGES_BEGIN();
+	
 	/* When init() is called from e_plugin_lib_enable(), we might not have
 	 * otherwise obtained (i.e. in e_plugin_ui_init()) the shell window. */
 	if(!shell_window) {
@@ -249,12 +850,36 @@ static gint init(void) {
 		}
 	}
 	
-	err = sn_init(ICON_READ, on_activate, do_properties, do_quit);
+	static const sn_callbacks_t sn_callbacks = {
+		.activate = on_activate,
+		.secondary_activate = on_secondary_activate,
+		.scroll = on_scroll,
+		.menu_new_message = do_new_message,
+		.menu_send_receive = do_send_receive,
+		.menu_mark_seen = do_mark_seen,
+		.menu_prefs = do_properties,
+		.menu_quit = do_quit
+	};
+	
+	trace_init();
+	TRACE_STAGE("shell-window");
+	
+	err = sn_init();
 	if(err != 0) {
 		g_printerr("Evolution Tray: StatusNotifierItem init failed (%d)\n", err);
 		return -2;
 	}
 	
+	main_item = sn_item_new(NULL, "Evolution Tray", ICON_READ, &sn_callbacks, NULL);
+	if(!main_item) {
+		sn_fini();
+		g_printerr("Evolution Tray: StatusNotifierItem export failed\n");
+		return -2;
+	}
+	
+	sn_item_set_tooltip(main_item, on_tooltip);
+	TRACE_STAGE("sn");
+	
 	err = ucount_init(on_ucount_checkpoint);
 	if(err != 0) {
 		sn_fini();
@@ -262,20 +887,50 @@ static gint init(void) {
 		return -3;
 	}
 	
-	g_signal_connect(G_OBJECT(shell_window), "show",
-		G_CALLBACK(on_window_show), NULL);
+	TRACE_STAGE("ucount");
 	
-	g_signal_connect(G_OBJECT(shell_window), "focus-in-event",
-		G_CALLBACK(on_window_focus_in), NULL);
+	/* Not fatal, the tray icon works fine without it */
+	err = api_init(sn_get_bus());
+	if(err != 0)
+		g_printerr("Evolution Tray: D-Bus API init failed (%d)\n", err);
 	
-	g_signal_connect(G_OBJECT(shell_window), "window-state-event",
-			G_CALLBACK(on_window_state_event), NULL);
+	TRACE_STAGE("api");
 	
-	g_signal_connect(G_OBJECT(shell_window), "delete-event",
-		G_CALLBACK(on_widget_deleted), NULL);
+	/* Also not fatal */
+	err = counterpage_init();
+	if(err != 0)
+		g_printerr("Evolution Tray: Counter page init failed (%d)\n", err);
 	
-	g_signal_connect(G_OBJECT(shell_window), "notify::active-view",
-		G_CALLBACK(on_active_view_change), NULL);
+	TRACE_STAGE("counterpage");
+	
+	/* Without the mail session, there are no accounts to seed
+	 * or to watch. We'll still count unread mail as it comes. */
+	if(accounts_init(on_account_removed) == 0) {
+		accounts_seed(on_accounts_seeded);
+		TRACE_STAGE("accounts");
+		
+		if(refresh_init() != 0)
+			g_printerr("Evolution Tray: Adaptive refresh init failed\n");
+		
+		TRACE_STAGE("refresh");
+		
+		if(items_init(&sn_callbacks, ICON_READ, ICON_UNREAD) != 0)
+			g_printerr("Evolution Tray: Account icons init failed\n");
+		
+		TRACE_STAGE("items");
+	}
+	
+	composer_init();
+	TRACE_STAGE("composer");
+	
+	/* Not fatal either */
+	if(reminders_init(on_reminders_changed) != 0)
+		g_printerr("Evolution Tray: Reminders init failed\n");
+	
+	TRACE_STAGE("reminders");
+	
+	connect_window_signals();
+	TRACE_STAGE("window-signals");
 	
 	status = STATUS_READ;
 	initialized = TRUE;
@@ -284,15 +939,35 @@ static gint init(void) {
 }
 
 static void fini(void) {
-	g_signal_handlers_disconnect_by_func(shell_window, on_window_show, NULL);
-	g_signal_handlers_disconnect_by_func(shell_window, on_window_focus_in, NULL);
-	g_signal_handlers_disconnect_by_func(shell_window, on_window_state_event, NULL);
-	g_signal_handlers_disconnect_by_func(shell_window, on_widget_deleted, NULL);
+	/* Background mode: the user gets their window
+	 * back, we're not around to bring it back later. */
+	if(!shell_window)
+		rebuild_window();
 	
-	g_signal_handlers_disconnect_by_func(shell_window, on_active_view_change, NULL);
+	disconnect_window_signals();
+	
+	if(app_held) {
+		g_application_release(G_APPLICATION(e_shell_get_default()));
+		app_held = FALSE;
+	}
+	
+	g_clear_handle_id(&hidden_timeout_id, g_source_remove);
+	g_clear_handle_id(&rss_settle_id, g_source_remove);
+	forget_scroll_folders();
 	
+	reminders_fini();
+	n_reminder_entries = 0;
+	composer_fini();
+	items_fini();
+	refresh_fini();
+	accounts_fini();
+	counterpage_fini();
+	api_fini();
 	ucount_fini();
 	sn_fini();
+	main_item = NULL;
+	g_clear_pointer(&tooltip_text, g_free);
+	trace_fini();
 	
 	show_window();
 	
@@ -306,13 +981,18 @@ gboolean e_plugin_ui_init(GtkUIManager *ui_manager, EShellView *shell_view) {
 #else
 gboolean e_plugin_ui_init(EUIManager *ui_manager, EShellView *shell_view) {
 #endif
+	static gboolean first_ui_init = TRUE;
+	
 	/* If hide-on-startup is enabled, mark the pending hide-action.
 	 * We only do this from ui_init(), i.e. only when evolution is
 	 * actually starting up, not if our plugin is merely being
-	 * enabled at a later point. */
-	if(is_part_enabled(TRAY_SCHEMA, CONF_KEY_HIDDEN_ON_STARTUP))
+	 * enabled at a later point. ui_init() also runs for every new
+	 * window (e.g. one rebuilt in background mode), skip those. */
+	if(first_ui_init && is_part_enabled(TRAY_SCHEMA, CONF_KEY_HIDDEN_ON_STARTUP))
 		hide_startup = TRUE;
 	
+	first_ui_init = FALSE;
+	
 	gint err = 0;
 	
 	if(!initialized) {
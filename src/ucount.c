@@ -49,6 +49,51 @@
  * each folder as its checkpoint, used to set the new acknowledged unread
  * counts per folder.
  *
+ * Setting the checkpoint happens every time the user looks at their mail,
+ * so it must not touch every folder. Instead, we stamp each entry with the
+ * epoch in which its checkpoint was last valid. Setting the checkpoint only
+ * bumps the epoch; an entry from an older epoch is folded (i.e. its
+ * checkpoint becomes its count) lazily, the next time that it is touched.
+ * Since an entry's count can only change through ucount_event(), which
+ * folds first, its stale count is exactly its count at the time of the
+ * checkpoint, and the outcome is identical to eagerly updating all entries.
+ *
+ * The first event for a folder is normally taken as its baseline, since we
+ * can't know what came before it. To know the baseline of each folder from
+ * the start, the table may also be seeded with the counts that the stores
+ * report at startup (see ucount_seed()). Mail that arrived before an entry's
+ * seed was applied is then not mistaken for the baseline.
+ *
+ * For outside consumers, we also maintain the aggregate unread count and
+ * the aggregate number of new mails (i.e. the sum of count - checkpoint),
+ * and keep the entries in an array, in insertion order, which allows for
+ * cheap, paged enumeration of all folders. The order is stable as long as
+ * no account is dropped (which moves entries from the end to fill holes).
+ *
+ * The folders that are over their checkpoint are also kept in an intrusive
+ * doubly-linked list, ordered by the last time they received new mail, most
+ * recent first. Maintaining it costs O(1) per event, and lets the tray jump
+ * to the folders with new mail without scanning the table. A checkpoint
+ * empties the list, also in O(1): the head is simply reset, and the stale
+ * links of the (former) members are discarded when their epoch is folded.
+ *
+ * The table is two-level: the account (i.e. store UID, as it appears in the
+ * folder URIs) maps to a table of that account's folders. Every account also
+ * maintains its own unread/new/over-checkpoint counters, incrementally, next
+ * to the global ones. Account-wide queries are therefore O(1), and account-
+ * wide operations (setting an account's checkpoint, dropping an account) are
+ * O(folders in the account). Per-account checkpoints use epochs just like
+ * the global one, with both drawn from the same clock: an entry is stale if
+ * its stamp is older than either the global or its account's checkpoint. The
+ * per-account counters are reset lazily on a global checkpoint, likewise.
+ *
+ * For the tooltip, we also remember the last few new mails themselves, but
+ * only as cheap references (folder URI and message UID), in a small ring.
+ * They're only ever resolved to anything readable by the consumer, when it
+ * actually needs them. A message is listed as long as its folder is still
+ * over its checkpoint, and a generation counter tells consumers when the
+ * listing might have changed, so that they can cache whatever they made of it.
+ *
  * Limitation: We only have per-folder, not per-email granularity. Therefore,
  * we can't know when the folder unread count decreases, if the email that
  * was read was a 'new' one and so we should go ahead and unset the 'unread'
@@ -61,40 +106,210 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+
 #include <gio/gio.h>
 #include <glib/gprintf.h>
 
 #include "ucount.h"
+#include "trace.h"
+
+#define FOLDER_URI_PREFIX "folder://"
+
+// Number of new mails remembered, see ucount_message()
+#define MESSAGE_RING_SIZE 8
+
+typedef struct uaccount_t {
+	gchar *account;
+	
+	// Folder URI -> unode_t
+	GHashTable *folders;
+	
+	// Epoch of this account's last checkpoint
+	guint64 epoch;
+	
+	/* Same as the global counters, for this account only. The
+	 * new/over-checkpoint ones are valid as of synced_epoch. */
+	guint64 synced_epoch;
+	guint unread;
+	guint new;
+	gint n_folders_over_checkpoint;
+} uaccount_t;
 
 typedef struct unode_t {
+	const gchar *folder; // owned by account->folders
+	uaccount_t *account;
+	
 	guint count;
 	guint checkpoint;
+	
+	// Epoch in which the checkpoint was last brought up to date
+	guint64 epoch;
+	
+	// Position in unodes
+	guint index;
+	
+	// Links in the recency list, meaningful only if linked
+	struct unode_t *prev, *next;
+	gboolean linked;
 } unode_t;
 
+// Account -> uaccount_t
 static GHashTable *utable = NULL;
 
+// All unodes, in insertion order
+static GPtrArray *unodes = NULL;
+
+/* Bumped on every checkpoint, global or per-account. The global_epoch is
+ * the value that it had on the last ucount_set_checkpoint(). */
+static guint64 epoch = 0;
+static guint64 global_epoch = 0;
+
 // Current number of unodes where count > checkpoint
 static gint n_folders_over_checkpoint = 0;
 
+/* Folders over their checkpoint, the one that most
+ * recently received new mail at the head */
+static unode_t *recent_head = NULL;
+
+// Sum of count, and of count - checkpoint, across all unodes
+static guint total_unread = 0;
+static guint total_new = 0;
+
+// The last new mails, the most recent at ring[(ring_pos - 1) % size]
+static ucount_message_t ring[MESSAGE_RING_SIZE];
+static guint ring_pos = 0;
+
+// Bumped whenever the output of ucount_get_messages() might change
+static guint64 messages_generation = 0;
+
 // Function to call when n_folders_over_checkpoint reaches 0
 static void (*global_checkpoint_reached_cb)(void) = NULL;
 
+static void ring_clear(void) {
+	for(guint i = 0; i < MESSAGE_RING_SIZE; i++) {
+		g_clear_pointer(&ring[i].folder, g_free);
+		g_clear_pointer(&ring[i].uid, g_free);
+	}
+	
+	ring_pos = 0;
+}
+
+static void uaccount_free(gpointer data) {
+	uaccount_t *uaccount = data;
+	
+	g_hash_table_destroy(uaccount->folders);
+	g_free(uaccount->account);
+	g_free(uaccount);
+}
+
 gint ucount_init(void (*checkpoint_cb)(void)) {
-	utable = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	utable = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, uaccount_free);
 	if(!utable) return -1;
 	
+	unodes = g_ptr_array_new();
+	
 	global_checkpoint_reached_cb = checkpoint_cb;
 	
 	return 0;
 }
 
 void ucount_fini(void) {
+	g_clear_pointer(&unodes, g_ptr_array_unref);
 	g_clear_pointer(&utable, g_hash_table_destroy);
 	n_folders_over_checkpoint = 0;
+	total_unread = 0;
+	total_new = 0;
+	recent_head = NULL;
 	global_checkpoint_reached_cb = NULL;
+	epoch = 0;
+	global_epoch = 0;
+	ring_clear();
+	messages_generation++;
+}
+
+/* Find the account part of a folder URI, i.e. the (escaped) store UID in
+ * "folder://UID/path/to/folder". URIs of any other form are all grouped
+ * under the empty account. */
+static void split_account(const gchar *folder, const gchar **start, gsize *len) {
+	*start = "";
+	*len = 0;
+	
+	if(!g_str_has_prefix(folder, FOLDER_URI_PREFIX))
+		return;
+	
+	const gchar *account = folder + strlen(FOLDER_URI_PREFIX);
+	const gchar *slash = strchr(account, '/');
+	
+	*start = account;
+	*len = (slash ? (gsize) (slash - account) : strlen(account));
+}
+
+/* Find the account of a folder URI. Avoid allocating for the
+ * lookup key, this happens for every single event. */
+static uaccount_t *lookup_account(const gchar *folder, gboolean create) {
+	const gchar *start;
+	gsize len;
+	gchar buf[128];
+	gchar *key = buf;
+	
+	split_account(folder, &start, &len);
+	
+	if(len < sizeof(buf)) {
+		memcpy(buf, start, len);
+		buf[len] = '\0';
+	} else
+		key = g_strndup(start, len);
+	
+	uaccount_t *uaccount = g_hash_table_lookup(utable, key);
+	
+	if(!uaccount && create) {
+		uaccount = g_new0(uaccount_t, 1);
+		uaccount->account = g_strdup(key);
+		uaccount->synced_epoch = epoch;
+		uaccount->folders = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, g_free);
+		
+		g_hash_table_insert(utable, uaccount->account, uaccount);
+	}
+	
+	if(key != buf)
+		g_free(key);
+	
+	return uaccount;
+}
+
+static unode_t *lookup(const gchar *folder) {
+	uaccount_t *uaccount = lookup_account(folder, FALSE);
+	return (uaccount ? g_hash_table_lookup(uaccount->folders, folder) : NULL);
+}
+
+/* Same idea as unode_sync(): a global checkpoint resets the new/over-
+ * checkpoint counters of all accounts, but we only do so when we need to. */
+static void uaccount_sync(uaccount_t *uaccount) {
+	if(uaccount->synced_epoch < global_epoch) {
+		uaccount->new = 0;
+		uaccount->n_folders_over_checkpoint = 0;
+	}
+	
+	uaccount->synced_epoch = epoch;
+}
+
+/* Apply a change to the counters, both of the account and the global ones */
+static void adjust(uaccount_t *uaccount, gint d_unread, gint d_new, gint d_over) {
+	uaccount_sync(uaccount);
+	
+	uaccount->unread += d_unread;
+	uaccount->new += d_new;
+	uaccount->n_folders_over_checkpoint += d_over;
+	
+	total_unread += d_unread;
+	total_new += d_new;
+	n_folders_over_checkpoint += d_over;
 }
 
 static void ucount_insert(const gchar *folder, guint count) {
+	uaccount_t *uaccount = lookup_account(folder, TRUE);
 	unode_t *unode = g_malloc(sizeof(unode_t));
 	gchar *key = g_strdup(folder);
 	
@@ -104,8 +319,70 @@ static void ucount_insert(const gchar *folder, guint count) {
 		return;
 	}
 	
-	*unode = (unode_t) {.count = count, .checkpoint = count};
-	g_hash_table_insert(utable, key, unode);
+	*unode = (unode_t) {
+		.folder = key,
+		.account = uaccount,
+		.count = count,
+		.checkpoint = count,
+		.epoch = epoch,
+		.index = unodes->len
+	};
+	
+	g_hash_table_insert(uaccount->folders, key, unode);
+	g_ptr_array_add(unodes, unode);
+	
+	adjust(uaccount, count, 0, 0);
+}
+
+/* Whether a checkpoint was set since the entry was last touched */
+static gboolean unode_is_stale(unode_t *unode) {
+	return unode->epoch < MAX(global_epoch, unode->account->epoch);
+}
+
+/* Apply any checkpoint that was set since the entry was last touched. The
+ * counters were already reset back then, so only the entry changes. */
+static void unode_sync(unode_t *unode) {
+	if(unode_is_stale(unode)) {
+		unode->checkpoint = unode->count;
+		
+		// The checkpoint emptied the recency list
+		unode->prev = unode->next = NULL;
+		unode->linked = FALSE;
+	}
+	
+	unode->epoch = epoch;
+}
+
+static void recent_unlink(unode_t *unode) {
+	if(!unode->linked)
+		return;
+	
+	if(unode->prev) unode->prev->next = unode->next;
+	else recent_head = unode->next;
+	
+	if(unode->next) unode->next->prev = unode->prev;
+	
+	unode->prev = unode->next = NULL;
+	unode->linked = FALSE;
+	
+	messages_generation++;
+}
+
+static void recent_push_front(unode_t *unode) {
+	/* Its messages are listed again. If it was already linked, the
+	 * generation is bumped by recent_unlink() instead. */
+	if(!unode->linked)
+		messages_generation++;
+	
+	recent_unlink(unode);
+	
+	unode->prev = NULL;
+	unode->next = recent_head;
+	
+	if(recent_head) recent_head->prev = unode;
+	
+	recent_head = unode;
+	unode->linked = TRUE;
 }
 
 /* New information regarding the unread count of a folder.
@@ -113,52 +390,331 @@ static void ucount_insert(const gchar *folder, guint count) {
  * - Check against our known checkpoint, and update the global record.
  * - If the global record drops to 0, invoke the callback.  */
 gint ucount_event(const gchar *folder, guint count) {
-	unode_t *unode = g_hash_table_lookup(utable, folder);
+	unode_t *unode = lookup(folder);
 	
 	if(!unode) {
 		ucount_insert(folder, count);
+		trace_record(TRACE_UCOUNT_EVENT, "insert", count, 0,
+			n_folders_over_checkpoint);
 		return 0;
 	}
 	
+	unode_sync(unode);
+	
 	guint prev_count = unode->count;
+	guint prev_new = prev_count - unode->checkpoint;
 	gboolean was_at_checkpoint = (prev_count == unode->checkpoint);
 	
 	unode->count = count;
 	
 	if(count > prev_count) {
+		recent_push_front(unode);
 		
 		// if was at checkpoint, and now aren't
-		if(was_at_checkpoint)
-			n_folders_over_checkpoint++;
+		adjust(unode->account, count - prev_count,
+			count - prev_count, was_at_checkpoint ? 1 : 0);
 			
 	} else if(count < prev_count) {
 		if(count <= unode->checkpoint) {
 			// can't have count < checkpoint
 			unode->checkpoint = count;
+			recent_unlink(unode);
 			
 			// if wasn't at checkpoint, but now are
-			if(!was_at_checkpoint) {
-				n_folders_over_checkpoint--;
-				
-				if(n_folders_over_checkpoint == 0)
-					global_checkpoint_reached_cb();
-			}
+			adjust(unode->account, -(gint) (prev_count - count),
+				-(gint) prev_new, was_at_checkpoint ? 0 : -1);
+			
+			if(!was_at_checkpoint && n_folders_over_checkpoint == 0)
+				global_checkpoint_reached_cb();
+		} else {
+			adjust(unode->account, -(gint) (prev_count - count),
+				-(gint) (prev_count - count), 0);
 		}
 	}
 	
+	trace_record(TRACE_UCOUNT_EVENT, "event", count,
+		(gint) (count - prev_count), n_folders_over_checkpoint);
+	
 	/* Is the new count higher than the previous one? The same? The
 	 * negative count is not all that useful, be careful interpreting it. */
 	return count - prev_count;
 }
 
-static void set_checkpoint_foreach_cb(gpointer key, gpointer value,
-	gpointer user_data)
-{
-	unode_t *unode = (unode_t *) value;
-	unode->checkpoint = unode->count;
+/* The current epoch, to be passed to ucount_seed() along with the counts
+ * that were collected from then on. */
+guint64 ucount_get_epoch(void) {
+	return epoch;
 }
 
+/* Apply a batch of startup counts, collected since the given epoch. Folders
+ * we don't know about yet get the seed as their baseline. For folders whose
+ * first event beat the seed, the seed is the older value: lower the
+ * checkpoint to it, so that any mail that raced with startup is considered
+ * new. Unless a checkpoint was set since the seed started: the user has
+ * acknowledged a newer count then, which the seed must not undo. Returns the
+ * number of folders which went over their checkpoint because of the seed. */
+gint ucount_seed(const ucount_seed_t *seeds, guint n_seeds, guint64 seed_epoch) {
+	gint n_new = 0;
+	
+	for(guint i = 0; i < n_seeds; i++) {
+		unode_t *unode = lookup(seeds[i].folder);
+		
+		if(!unode) {
+			ucount_insert(seeds[i].folder, seeds[i].count);
+			continue;
+		}
+		
+		// Only a checkpoint of its own makes the seed stale for the folder
+		if(MAX(global_epoch, unode->account->epoch) > seed_epoch)
+			continue;
+		
+		unode_sync(unode);
+		
+		if(seeds[i].count < unode->checkpoint) {
+			gboolean was_at_checkpoint = (unode->count == unode->checkpoint);
+			
+			adjust(unode->account, 0, unode->checkpoint - seeds[i].count,
+				was_at_checkpoint ? 1 : 0);
+			
+			if(was_at_checkpoint)
+				n_new++;
+			
+			unode->checkpoint = seeds[i].count;
+			
+			if(!unode->linked)
+				recent_push_front(unode);
+		}
+	}
+	
+	trace_record(TRACE_UCOUNT_SEED, "seed", n_seeds, n_new,
+		n_folders_over_checkpoint);
+	
+	return n_new;
+}
+
+/* Make every folder's current count its checkpoint. The entries
+ * themselves are updated lazily, see unode_sync(). */
 void ucount_set_checkpoint(void) {
-	g_hash_table_foreach(utable, set_checkpoint_foreach_cb, NULL);
+	trace_record(TRACE_UCOUNT_CHECKPOINT, "global",
+		n_folders_over_checkpoint, total_new, 0);
+	
+	global_epoch = ++epoch;
+	
 	n_folders_over_checkpoint = 0;
+	total_new = 0;
+	recent_head = NULL;
+	
+	// None of them is new anymore
+	ring_clear();
+	messages_generation++;
+}
+
+/* Empty the ring slots of an account's messages. Like ring_clear(), for a
+ * single account; the others' messages stay where they are. */
+static void ring_forget_account(uaccount_t *uaccount) {
+	for(guint i = 0; i < MESSAGE_RING_SIZE; i++) {
+		if(ring[i].folder && lookup_account(ring[i].folder, FALSE) == uaccount) {
+			g_clear_pointer(&ring[i].folder, g_free);
+			g_clear_pointer(&ring[i].uid, g_free);
+		}
+	}
+}
+
+/* Take away an account's folders from the global counters, the recency
+ * list and the ring, in preparation of a checkpoint or of its removal. */
+static void account_detach(uaccount_t *uaccount) {
+	GHashTableIter iter;
+	unode_t *unode;
+	
+	ring_forget_account(uaccount);
+	
+	g_hash_table_iter_init(&iter, uaccount->folders);
+	while(g_hash_table_iter_next(&iter, NULL, (gpointer *) &unode)) {
+		if(!unode_is_stale(unode))
+			recent_unlink(unode);
+	}
+	
+	uaccount_sync(uaccount);
+	
+	total_new -= uaccount->new;
+	n_folders_over_checkpoint -= uaccount->n_folders_over_checkpoint;
+	
+	uaccount->new = 0;
+	uaccount->n_folders_over_checkpoint = 0;
+	
+	messages_generation++;
+}
+
+/* The account that a folder is counted under, as used by the account
+ * operations below. Free with g_free(). */
+gchar *ucount_folder_account(const gchar *folder) {
+	const gchar *start;
+	gsize len;
+	
+	split_account(folder, &start, &len);
+	
+	return g_strndup(start, len);
+}
+
+/* Same as ucount_set_checkpoint(), for a single account.
+ * O(number of the account's folders). */
+void ucount_account_set_checkpoint(const gchar *account) {
+	uaccount_t *uaccount = g_hash_table_lookup(utable, account);
+	if(!uaccount) return;
+	
+	gboolean was_over = (n_folders_over_checkpoint > 0);
+	
+	account_detach(uaccount);
+	uaccount->epoch = ++epoch;
+	
+	trace_record(TRACE_UCOUNT_ACCOUNT, "checkpoint",
+		g_hash_table_size(uaccount->folders), n_folders_over_checkpoint, 0);
+	
+	if(was_over && n_folders_over_checkpoint == 0)
+		global_checkpoint_reached_cb();
+}
+
+/* Forget all about an account, e.g. because it was disabled or removed.
+ * O(number of the account's folders). */
+void ucount_remove_account(const gchar *account) {
+	uaccount_t *uaccount = g_hash_table_lookup(utable, account);
+	if(!uaccount) return;
+	
+	gboolean was_over = (n_folders_over_checkpoint > 0);
+	
+	account_detach(uaccount);
+	total_unread -= uaccount->unread;
+	
+	GHashTableIter iter;
+	unode_t *unode;
+	
+	// Fill the holes in unodes with entries from the end
+	g_hash_table_iter_init(&iter, uaccount->folders);
+	while(g_hash_table_iter_next(&iter, NULL, (gpointer *) &unode)) {
+		g_ptr_array_remove_index_fast(unodes, unode->index);
+		
+		if(unode->index < unodes->len) {
+			unode_t *moved = g_ptr_array_index(unodes, unode->index);
+			moved->index = unode->index;
+		}
+	}
+	
+	trace_record(TRACE_UCOUNT_ACCOUNT, "remove",
+		g_hash_table_size(uaccount->folders), n_folders_over_checkpoint, 0);
+	
+	g_hash_table_remove(utable, account);
+	
+	if(was_over && n_folders_over_checkpoint == 0)
+		global_checkpoint_reached_cb();
+}
+
+/* The folder that most recently received new mail, and is still over its
+ * checkpoint. NULL if there are no such folders. Owned by ucount. */
+const gchar *ucount_get_recent(void) {
+	return (recent_head ? recent_head->folder : NULL);
+}
+
+/* All folders over their checkpoint, most recent first. Costs O(number
+ * of such folders). Free with g_ptr_array_unref(). */
+GPtrArray *ucount_ref_recent(void) {
+	GPtrArray *folders = g_ptr_array_new_with_free_func(g_free);
+	
+	for(unode_t *unode = recent_head; unode != NULL; unode = unode->next)
+		g_ptr_array_add(folders, g_strdup(unode->folder));
+	
+	return folders;
+}
+
+void ucount_get_totals(ucount_totals_t *totals) {
+	*totals = (ucount_totals_t) {
+		.unread = total_unread,
+		.new = total_new,
+		.n_folders_new = n_folders_over_checkpoint,
+		.n_folders = unodes->len
+	};
+}
+
+/* Same as ucount_get_totals(), for a single account. O(1). */
+gboolean ucount_get_account_totals(const gchar *account, ucount_totals_t *totals) {
+	uaccount_t *uaccount = g_hash_table_lookup(utable, account);
+	if(!uaccount) return FALSE;
+	
+	uaccount_sync(uaccount);
+	
+	*totals = (ucount_totals_t) {
+		.unread = uaccount->unread,
+		.new = uaccount->new,
+		.n_folders_new = uaccount->n_folders_over_checkpoint,
+		.n_folders = g_hash_table_size(uaccount->folders)
+	};
+	
+	return TRUE;
+}
+
+/* Get the entry at the given position of the insertion order. Positions
+ * are stable (unless an account is removed), so this can be used to
+ * enumerate the folders in pages. The folder string is owned by ucount,
+ * and valid until its account is removed. */
+gboolean ucount_get_folder(guint index, const gchar **folder,
+	guint *count, guint *checkpoint)
+{
+	if(index >= unodes->len)
+		return FALSE;
+	
+	unode_t *unode = g_ptr_array_index(unodes, index);
+	unode_sync(unode);
+	
+	*folder = unode->folder;
+	*count = unode->count;
+	*checkpoint = unode->checkpoint;
+	
+	return TRUE;
+}
+
+/* A new mail arrived, remember it for ucount_get_messages(), in place
+ * of the oldest one. This is normally reported separately from the
+ * folder's unread count, and may come before or after it. */
+void ucount_message(const gchar *folder, const gchar *uid) {
+	ucount_message_t *last = &ring[(ring_pos - 1) % MESSAGE_RING_SIZE];
+	
+	if(g_strcmp0(last->uid, uid) == 0 && g_strcmp0(last->folder, folder) == 0)
+		return;
+	
+	ucount_message_t *slot = &ring[ring_pos++ % MESSAGE_RING_SIZE];
+	
+	g_free(slot->folder);
+	g_free(slot->uid);
+	
+	slot->folder = g_strdup(folder);
+	slot->uid = g_strdup(uid);
+	
+	messages_generation++;
+}
+
+/* The last new mails, most recent first, up to max_messages, among those
+ * in folders that are still over their checkpoint. The strings are owned
+ * by ucount, and valid until the next call to any ucount function. */
+guint ucount_get_messages(ucount_message_t *messages, guint max_messages) {
+	guint n = 0;
+	
+	for(guint i = 1; i <= MIN(ring_pos, MESSAGE_RING_SIZE) && n < max_messages; i++) {
+		ucount_message_t *message = &ring[(ring_pos - i) % MESSAGE_RING_SIZE];
+		
+		// Emptied by an account checkpoint
+		if(!message->folder)
+			continue;
+		
+		unode_t *unode = lookup(message->folder);
+		
+		if(unode && unode->linked && !unode_is_stale(unode))
+			messages[n++] = *message;
+	}
+	
+	return n;
+}
+
+/* Changes whenever ucount_get_messages() might have a different
+ * result, which can then be cached until the generation moves on. */
+guint64 ucount_get_messages_generation(void) {
+	return messages_generation;
 }
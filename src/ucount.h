@@ -1,11 +1,46 @@
 #ifndef EVOLUTION_TRAY_UCOUNT_H
 #define EVOLUTION_TRAY_UCOUNT_H
 
+typedef struct ucount_seed_t {
+	gchar *folder;
+	guint count;
+} ucount_seed_t;
+
+typedef struct ucount_message_t {
+	gchar *folder;
+	gchar *uid;
+} ucount_message_t;
+
+typedef struct ucount_totals_t {
+	guint unread;
+	guint new;
+	guint n_folders_new;
+	guint n_folders;
+} ucount_totals_t;
+
 gint ucount_init(void (*checkpoint_cb)(void));
 void ucount_fini(void);
 
 gint ucount_event(const gchar *folder, guint count);
 // void ucount_event_dud(const gchar *folder, guint count);
 void ucount_set_checkpoint(void);
+gint ucount_seed(const ucount_seed_t *seeds, guint n_seeds, guint64 epoch);
+guint64 ucount_get_epoch(void);
+
+gchar *ucount_folder_account(const gchar *folder);
+void ucount_account_set_checkpoint(const gchar *account);
+void ucount_remove_account(const gchar *account);
+
+const gchar *ucount_get_recent(void);
+GPtrArray *ucount_ref_recent(void);
+
+void ucount_get_totals(ucount_totals_t *totals);
+gboolean ucount_get_account_totals(const gchar *account, ucount_totals_t *totals);
+gboolean ucount_get_folder(guint index, const gchar **folder,
+	guint *count, guint *checkpoint);
+
+void ucount_message(const gchar *folder, const gchar *uid);
+guint ucount_get_messages(ucount_message_t *messages, guint max_messages);
+guint64 ucount_get_messages_generation(void);
 
 #endif
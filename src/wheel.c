@@ -0,0 +1,272 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ * 
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* A hierarchical timer wheel, so that any number of timers can be served
+ * by a single main loop timeout (see reminders.c), armed for the earliest
+ * expiry. Times are in whole seconds, of whatever clock the caller uses.
+ *
+ * There are WHEEL_LEVELS levels of WHEEL_SLOTS slots each. A timer is
+ * filed relative to the wheel's current time: at the level of the highest
+ * group of WHEEL_BITS bits in which its expiry differs from the current
+ * time, in the slot given by those bits of its expiry. Level 0 slots thus
+ * hold timers of a single second, level 1 slots a span of 64 seconds, and
+ * so on. Timers too far in the future for the top level wait in a separate
+ * overflow list. Each slot is an intrusive doubly-linked list, so adding
+ * and removing are O(1), and each level keeps a bitmap of its busy slots.
+ *
+ * This placement orders the timers: those of a lower level all expire
+ * before those of a higher level, and within a level, those of a lower
+ * slot before those of a higher one. The earliest timer is therefore in
+ * the first busy slot of the lowest busy level, found with a couple of
+ * bit scans. Its exact expiry is the slot's own second at level 0, and
+ * the minimum of the slot's timers at any other level.
+ *
+ * The current time only moves forward when timers are due: it then jumps
+ * to the start of the span of the earliest slot, and that slot's timers
+ * are re-filed, which moves each one down by at least one level (i.e. they
+ * "cascade"), until they reach level 0 and fire. Moving the current time
+ * to anything else could break the ordering above, which is why it may lag
+ * behind the caller's clock; timers are always filed relative to it. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+
+#include "wheel.h"
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+// Slot number of the overflow list
+#define WHEEL_OVERFLOW (WHEEL_LEVELS * WHEEL_SLOTS)
+
+typedef struct wheel_timer_t {
+	gint64 expires;
+	
+	wheel_cb_t callback;
+	gpointer data;
+	
+	// In slots[slot]
+	guint slot;
+	struct wheel_timer_t *prev;
+	struct wheel_timer_t *next;
+} wheel_timer_t;
+
+static wheel_timer_t *slots[WHEEL_OVERFLOW + 1];
+static guint64 busy[WHEEL_LEVELS];
+
+static gint64 current = 0;
+static guint n_timers = 0;
+
+// -----------------------------
+
+static guint slot_for(gint64 expires) {
+	guint64 diff = (guint64) expires ^ (guint64) current;
+	guint level = 0;
+	
+	while(level < WHEEL_LEVELS && (diff >> (WHEEL_BITS * (level + 1))) != 0)
+		level++;
+	
+	if(level == WHEEL_LEVELS)
+		return WHEEL_OVERFLOW;
+	
+	return level * WHEEL_SLOTS + ((expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+}
+
+static void link_timer(wheel_timer_t *timer) {
+	// A late timer must still fire, and soon
+	if(timer->expires < current)
+		timer->expires = current;
+	
+	guint slot = slot_for(timer->expires);
+	
+	timer->slot = slot;
+	timer->prev = NULL;
+	timer->next = slots[slot];
+	
+	if(slots[slot])
+		slots[slot]->prev = timer;
+	
+	slots[slot] = timer;
+	
+	if(slot != WHEEL_OVERFLOW)
+		busy[slot / WHEEL_SLOTS] |= (G_GUINT64_CONSTANT(1) << (slot % WHEEL_SLOTS));
+}
+
+static void unlink_timer(wheel_timer_t *timer) {
+	guint slot = timer->slot;
+	
+	if(timer->prev)
+		timer->prev->next = timer->next;
+	else
+		slots[slot] = timer->next;
+	
+	if(timer->next)
+		timer->next->prev = timer->prev;
+	
+	if(!slots[slot] && slot != WHEEL_OVERFLOW)
+		busy[slot / WHEEL_SLOTS] &= ~(G_GUINT64_CONSTANT(1) << (slot % WHEEL_SLOTS));
+}
+
+// The earliest busy slot, or WHEEL_OVERFLOW
+static guint first_slot(void) {
+	for(guint level = 0; level < WHEEL_LEVELS; level++) {
+		if(busy[level])
+			return level * WHEEL_SLOTS + __builtin_ctzll(busy[level]);
+	}
+	
+	return WHEEL_OVERFLOW;
+}
+
+// The second at which the span of the slot starts
+static gint64 slot_start(guint slot) {
+	guint level = slot / WHEEL_SLOTS;
+	guint shift = WHEEL_BITS * level;
+	
+	gint64 frame = current >> (shift + WHEEL_BITS) << (shift + WHEEL_BITS);
+	
+	return frame | ((gint64) (slot % WHEEL_SLOTS) << shift);
+}
+
+static gint64 list_min(wheel_timer_t *timer) {
+	gint64 min = -1;
+	
+	for(; timer != NULL; timer = timer->next) {
+		if(min < 0 || timer->expires < min)
+			min = timer->expires;
+	}
+	
+	return min;
+}
+
+/* Move the current time to the start of the slot, and re-file its timers,
+ * which all land at lower levels. For the overflow list, move it up to its
+ * earliest timer, then re-file them all (the rest may still overflow). */
+static void cascade(guint slot) {
+	wheel_timer_t *list = slots[slot];
+	
+	current = MAX(current, (slot == WHEEL_OVERFLOW ? list_min(list) : slot_start(slot)));
+	
+	slots[slot] = NULL;
+	if(slot != WHEEL_OVERFLOW)
+		busy[slot / WHEEL_SLOTS] &= ~(G_GUINT64_CONSTANT(1) << (slot % WHEEL_SLOTS));
+	
+	while(list) {
+		wheel_timer_t *timer = list;
+		list = list->next;
+		
+		link_timer(timer);
+	}
+}
+
+// -----------------------------
+
+void wheel_init(gint64 now) {
+	wheel_fini();
+	current = now;
+}
+
+void wheel_fini(void) {
+	for(guint slot = 0; slot <= WHEEL_OVERFLOW; slot++) {
+		while(slots[slot]) {
+			wheel_timer_t *timer = slots[slot];
+			slots[slot] = timer->next;
+			g_free(timer);
+		}
+	}
+	
+	for(guint level = 0; level < WHEEL_LEVELS; level++)
+		busy[level] = 0;
+	
+	current = 0;
+	n_timers = 0;
+}
+
+/* Call back at (or after) the given time, unless removed first. The
+ * timer belongs to the wheel, and is freed once it fires or is removed. */
+wheel_timer_t *wheel_add(gint64 expires, wheel_cb_t callback, gpointer data) {
+	wheel_timer_t *timer = g_new(wheel_timer_t, 1);
+	
+	timer->expires = expires;
+	timer->callback = callback;
+	timer->data = data;
+	
+	link_timer(timer);
+	n_timers++;
+	
+	return timer;
+}
+
+void wheel_remove(wheel_timer_t *timer) {
+	unlink_timer(timer);
+	n_timers--;
+	
+	g_free(timer);
+}
+
+// The expiry of the earliest timer, or -1 if there are none
+gint64 wheel_next_expiry(void) {
+	guint slot = first_slot();
+	
+	if(slot < WHEEL_SLOTS)
+		return slot_start(slot);
+	
+	return list_min(slots[slot]);
+}
+
+/* Fire all the timers that expire up to the given time, earliest first.
+ * Callbacks are free to add and remove timers (but not the one that is
+ * firing, which is already gone). Returns the number of timers fired. */
+guint wheel_advance(gint64 now) {
+	guint n_fired = 0;
+	
+	while(n_timers > 0) {
+		gint64 next = wheel_next_expiry();
+		
+		if(next > now)
+			break;
+		
+		guint slot = first_slot();
+		
+		if(slot >= WHEEL_SLOTS) {
+			cascade(slot);
+			continue;
+		}
+		
+		current = MAX(current, next);
+		
+		wheel_timer_t *timer = slots[slot];
+		
+		unlink_timer(timer);
+		n_timers--;
+		
+		timer->callback(timer->data);
+		g_free(timer);
+		
+		n_fired++;
+	}
+	
+	return n_fired;
+}
+
+guint wheel_size(void) {
+	return n_timers;
+}
@@ -0,0 +1,18 @@
+#ifndef EVOLUTION_TRAY_WHEEL_H
+#define EVOLUTION_TRAY_WHEEL_H
+
+typedef struct wheel_timer_t wheel_timer_t;
+
+typedef void (*wheel_cb_t)(gpointer data);
+
+void wheel_init(gint64 now);
+void wheel_fini(void);
+
+wheel_timer_t *wheel_add(gint64 expires, wheel_cb_t callback, gpointer data);
+void wheel_remove(wheel_timer_t *timer);
+
+gint64 wheel_next_expiry(void);
+guint wheel_advance(gint64 now);
+guint wheel_size(void);
+
+#endif /* EVOLUTION_TRAY_WHEEL_H */
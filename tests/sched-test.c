@@ -0,0 +1,186 @@
+/* Evoution Tray plugin, fork of Evolution On
+ *  Copyright (C) 2025 George Katevenis <george_kate@hotmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Drives the refresh scheduler (src/sched.c) with synthetic arrival times,
+ * and checks the intervals it comes up with. The scheduler takes the time
+ * from its caller, so a simulated day runs in no time at all:
+ *
+ *   $ meson test -C build sched */
+
+#include <math.h>
+
+#include <glib.h>
+
+#include "sched.h"
+
+#define S ((gint64) G_USEC_PER_SEC)
+#define MIN_INTERVAL 60
+#define MAX_INTERVAL 3600
+#define HALF_LIFE 7200
+#define IDLE_FACTOR 4
+
+static const sched_params_t params = {
+	.min_interval = MIN_INTERVAL,
+	.max_interval = MAX_INTERVAL,
+	.half_life = HALF_LIFE,
+	.idle_factor = IDLE_FACTOR,
+};
+
+// One mail every period seconds, over [from, to)
+static void arrive_every(const gchar *account, gint64 period, gint64 from, gint64 to) {
+	for(gint64 t = from; t < to; t += period)
+		sched_arrival(account, 1, t * S);
+}
+
+static void setup(void) {
+	sched_init(&params);
+	sched_add_account("acc", 0);
+}
+
+// -----------------------------
+
+/* A steady rate is followed, and forgotten at the pace of the half-life
+ * once the mail stops. */
+static void test_rate(void) {
+	setup();
+	
+	// 10 mails per hour, for 10 half-lives
+	gint64 end = 10 * HALF_LIFE;
+	arrive_every("acc", 360, 0, end);
+	
+	gdouble rate = sched_get_rate("acc", end * S);
+	g_assert_cmpfloat_with_epsilon(rate, 10, 0.5);
+	g_assert_cmpint(sched_get_interval("acc", end * S), ==, (gint64) (3600 / rate));
+	
+	// Nothing from then on: halved after every half-life
+	for(gint i = 1; i <= 3; i++) {
+		gdouble later = sched_get_rate("acc", (end + i * HALF_LIFE) * S);
+		g_assert_cmpfloat_with_epsilon(later, rate / exp2(i), 1e-9);
+	}
+	
+	sched_fini();
+}
+
+/* A burst is remembered as a rate that decays, not as a steady one: the
+ * interval starts short and doubles with every half-life. */
+static void test_burst(void) {
+	setup();
+	
+	sched_arrival("acc", 10, 0);
+	
+	gdouble rate = sched_get_rate("acc", 0);
+	g_assert_cmpfloat_with_epsilon(rate, 10 * G_LN2 / HALF_LIFE * 3600, 1e-9);
+	
+	gint64 interval = sched_get_interval("acc", 0);
+	g_assert_cmpint(interval, ==, (gint64) (3600 / rate));
+	g_assert_cmpint(sched_get_interval("acc", HALF_LIFE * S), ==,
+		(gint64) (2 * 3600 / rate));
+	
+	sched_fini();
+}
+
+// Whatever the rate, the interval stays within [min, max]
+static void test_clamp(void) {
+	setup();
+	
+	// Nothing ever arrived
+	g_assert_cmpint(sched_get_interval("acc", 0), ==, MAX_INTERVAL);
+	
+	// A mail every second, for an hour
+	arrive_every("acc", 1, 0, 3600);
+	g_assert_cmpint(sched_get_interval("acc", 3600 * S), ==, MIN_INTERVAL);
+	
+	// Long after that, it's back at the max
+	g_assert_cmpint(sched_get_interval("acc", 30 * HALF_LIFE * S), ==, MAX_INTERVAL);
+	
+	sched_fini();
+}
+
+/* While idle, the interval is idle_factor times longer, but still no more
+ * than the max, and back to normal when no longer idle. */
+static void test_idle(void) {
+	setup();
+	
+	// 20 mails per hour, for a few half-lives: about 3 minutes
+	gint64 now = 5 * HALF_LIFE;
+	arrive_every("acc", 180, 0, now);
+	
+	gint64 interval = sched_get_interval("acc", now * S);
+	g_assert_cmpint(interval, >, MIN_INTERVAL);
+	g_assert_cmpint(interval * IDLE_FACTOR, <, MAX_INTERVAL);
+	
+	sched_set_idle(TRUE, now * S);
+	g_assert_cmpint(ABS(sched_get_interval("acc", now * S) - interval * IDLE_FACTOR),
+		<=, IDLE_FACTOR);
+	
+	// Quiet for three half-lives: 8 times longer, then idle 4 times that
+	gint64 later = now + 3 * HALF_LIFE;
+	g_assert_cmpint(sched_get_interval("acc", later * S), ==, MAX_INTERVAL);
+	
+	sched_set_idle(FALSE, now * S);
+	g_assert_cmpint(sched_get_interval("acc", now * S), ==, interval);
+	
+	sched_fini();
+}
+
+/* The first refresh is due one interval after the account was added, and
+ * each next one an interval after the previous one. When several are due,
+ * the most overdue comes first, and each only once. */
+static void test_due(void) {
+	setup();
+	
+	sched_add_account("quiet", 0);
+	sched_arrival("acc", 10, 0);
+	
+	gint64 interval = sched_get_interval("acc", 0);
+	gint64 due = sched_next_due();
+	
+	g_assert_cmpint(due / S, ==, interval);
+	g_assert_null(sched_pop_due(due - 1));
+	g_assert_cmpstr(sched_pop_due(due), ==, "acc");
+	g_assert_null(sched_pop_due(due));
+	
+	// An interval later (longer now, as the burst decays), before "quiet"
+	gint64 next = sched_next_due();
+	
+	g_assert_cmpint(ABS(next - due - sched_get_interval("acc", due) * S), <, S);
+	g_assert_cmpint(next, <, MAX_INTERVAL * S);
+	
+	gint64 now = 2 * MAX_INTERVAL * S;
+	g_assert_cmpstr(sched_pop_due(now), ==, "acc");
+	g_assert_cmpstr(sched_pop_due(now), ==, "quiet");
+	g_assert_null(sched_pop_due(now));
+	
+	sched_remove_account("acc");
+	sched_remove_account("quiet");
+	g_assert_cmpint(sched_next_due(), ==, -1);
+	
+	sched_fini();
+}
+
+gint main(gint argc, gchar **argv) {
+	g_test_init(&argc, &argv, NULL);
+	
+	g_test_add_func("/sched/rate", test_rate);
+	g_test_add_func("/sched/burst", test_burst);
+	g_test_add_func("/sched/clamp", test_clamp);
+	g_test_add_func("/sched/idle", test_idle);
+	g_test_add_func("/sched/due", test_due);
+	
+	return g_test_run();
+}